@@ -0,0 +1,611 @@
+// Host-side benchmark for the renderer and world editing code.
+//
+// Loads a saved world (or generates one), builds the triangle grids the same
+// way init_play() does, then replays fixed scripts of full redraws, scroll
+// steps and block edits. Timings are wall-clock on the host, so they are only
+// meaningful relative to each other; the VRAM and grid hashes printed at the
+// end change whenever the rendered output does.
+//
+// Usage: bench [-n passes] [-p] [world_dir | natural | flat | demo]...
+//   -p  also write the final frame of each world to bench_<n>.ppm
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "draw.h"
+#include "world.h"
+#include "worldgen.h"
+#include "world_io.h"
+#include "player.h"
+
+// Same SafeRAM location play() uses
+static world_t *world = (world_t*)WORLD_RAM.base;
+static player_t player;
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static uint32_t fnv1a(const uint8_t *data, size_t len, uint32_t hash = 2166136261u) {
+    for(size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+typedef struct stat_t {
+    double total;
+    double max;
+    uint32_t cnt;
+
+    void add(double ms) {
+        total += ms;
+        if(ms > max) max = ms;
+        cnt++;
+    }
+
+    double mean() {
+        return cnt ? total / cnt : 0;
+    }
+} stat_t;
+
+// Copies out the triangle grid and shadow map a plane at a time, whatever
+// layout the grid is kept in
+static void snapshot_grid(uint8_t planes[4][TRI_CNT]) {
+    for(int i = 0; i < TRI_CNT; i++) {
+        planes[0][i] = world->cell_tex(i);
+        planes[1][i] = world->cell_flags(i);
+        planes[2][i] = world->cell_depth(i);
+    }
+    memcpy(planes[3], world->tri_grid_shadow, TRI_CNT);
+}
+
+static bool grid_matches(uint8_t planes[4][TRI_CNT]) {
+    static uint8_t now[4][TRI_CNT];
+    snapshot_grid(now);
+    return memcmp(planes, now, sizeof(now)) == 0;
+}
+
+// Mirrors the world building done in init_play()
+static void build_world() {
+    world->init_tri_grid();
+    world->build_tri_grid();
+}
+
+static bool setup_world(const char *source) {
+    world->clear_world();
+    world->init_tri_grid();
+    srandom(1);
+
+    if(strcmp(source, "natural") == 0) {
+        generate_natural(*world, player);
+        player.scroll_to_center(scroll_x, scroll_y);
+    }
+    else if(strcmp(source, "flat") == 0) {
+        generate_flat(*world, player);
+        player.scroll_to_center(scroll_x, scroll_y);
+    }
+    else if(strcmp(source, "demo") == 0) {
+        generate_demo(*world, player);
+        player.scroll_to_center(scroll_x, scroll_y);
+    }
+    else {
+        if(host_load_vars(source) == 0) {
+            fprintf(stderr, "bench: no .8xv files in %s\n", source);
+            return false;
+        }
+        if(!load(0, *world, player)) {
+            fprintf(stderr, "bench: could not load world A from %s\n", source);
+            return false;
+        }
+    }
+    player.world = world;
+    return true;
+}
+
+// Writes VRAM out as a binary PPM using the texture palette
+static void write_ppm(const char *path) {
+    FILE *f = fopen(path, "wb");
+    if(f == NULL) return;
+    fprintf(f, "P6\n%d %d\n255\n", LCD_WIDTH, LCD_HEIGHT);
+    for(int i = 0; i < LCD_CNT; i++) {
+        uint16_t c = tex_palette[VRAM[i]];
+        uint8_t rgb[3] = {
+            (uint8_t)(((c >> 10) & 31) << 3),
+            (uint8_t)(((c >>  5) & 31) << 3),
+            (uint8_t)(((c >>  0) & 31) << 3),
+        };
+        fwrite(rgb, 1, 3, f);
+    }
+    fclose(f);
+}
+
+// Prints and resets the triangle cache counters
+static void report_cache() {
+    uint24_t total = tri_cache_hits + tri_cache_misses;
+    printf("    tri cache          %9.1f %% hits  (%lu of %lu, %u slots)\n",
+           total ? 100.0 * tri_cache_hits / total : 0.0,
+           (unsigned long)tri_cache_hits, (unsigned long)total, (unsigned)TRI_CACHE_SLOTS);
+    tri_cache_hits = 0;
+    tri_cache_misses = 0;
+}
+
+static void full_redraw() {
+    draw_x0 = 0;
+    draw_y0 = 0;
+    draw_x1 = LCD_WIDTH;
+    draw_y1 = LCD_HEIGHT;
+    memset(VRAM, SKY, LCD_CNT);
+    draw_tri_grid(*world);
+}
+
+// One pass of the scroll script: a loop around the view that ends where it
+// started, mixing straight and diagonal steps in every direction
+static const int8_t scroll_script[][3] = {
+    // { steps, dx, dy }
+    { 20,  SCROLL_SPEED,             0 },
+    { 12,             0,  SCROLL_SPEED },
+    { 10, -SCROLL_SPEED, -SCROLL_SPEED },
+    { 30, -SCROLL_SPEED,             0 },
+    {  2,             0, -SCROLL_SPEED },
+    { 20,  SCROLL_SPEED,  SCROLL_SPEED },
+    { 20,             0, -SCROLL_SPEED },
+};
+
+// Saves the world in full, then again after a single block edit, and loads
+// it back, which should restore the blocks and triangle grid exactly as they
+// were saved without rebuilding the grid
+static void bench_save_load() {
+    // Everything is rewritten the first time
+    memset(world->slice_dirty, 0xFF, sizeof(world->slice_dirty));
+
+    memset(&host_fileioc_stats, 0, sizeof(host_fileioc_stats));
+    double t0 = now_ms();
+    save(0, *world, player);
+    printf("  save                 %9.2f ms  %7lu bytes archived\n",
+           now_ms() - t0, (unsigned long)host_fileioc_stats.bytes_archived);
+
+    // Size of the world's files, against storing the blocks raw
+    ti_var_t var = ti_Open("WORLDA", "r");
+    size_t world_bytes = var ? ti_GetSize(var) : 0;
+    ti_Close(var);
+    for(uint8_t y = 0; y < WORLD_HEIGHT; y++) {
+        char name[9];
+        slice_name(name, 0, y);
+        var = ti_Open(name, "r");
+        world_bytes += var ? ti_GetSize(var) : 0;
+        ti_Close(var);
+    }
+    printf("  world files          %9.1f %%    %7lu bytes\n",
+           100.0 * world_bytes / (WORLD_HEIGHT * SLICE_SIZE), (unsigned long)world_bytes);
+
+    // Remove and replace the topmost block in the middle of the world, which
+    // leaves it as it was but dirties its slice
+    for(int y = WORLD_HEIGHT - 1; y >= 0; y--) {
+        Block_t block = world->block_at(WORLD_SIZE / 2, y, WORLD_SIZE / 2);
+        if(block <= WATER) continue;
+
+        world->remove_block(WORLD_SIZE / 2, y, WORLD_SIZE / 2);
+        world->place_block(WORLD_SIZE / 2, y, WORLD_SIZE / 2, block);
+
+        memset(&host_fileioc_stats, 0, sizeof(host_fileioc_stats));
+        t0 = now_ms();
+        save(0, *world, player, true);
+        printf("  autosave after edit  %9.2f ms  %7lu bytes archived\n",
+               now_ms() - t0, (unsigned long)host_fileioc_stats.bytes_archived);
+
+        // Then the save made on quitting, which archives what the autosave
+        // left in RAM and writes the grid
+        memset(&host_fileioc_stats, 0, sizeof(host_fileioc_stats));
+        t0 = now_ms();
+        save(0, *world, player);
+        printf("  save after autosave  %9.2f ms  %7lu bytes archived\n",
+               now_ms() - t0, (unsigned long)host_fileioc_stats.bytes_archived);
+        break;
+    }
+
+    static uint8_t saved[4][TRI_CNT];
+    snapshot_grid(saved);
+    static Block_t blocks[WORLD_HEIGHT][SLICE_SIZE];
+    for(int y = 0; y < WORLD_HEIGHT; y++)
+        memcpy(blocks[y], world->slice_blocks(y), SLICE_SIZE);
+
+    world->clear_world();
+
+    world->init_tri_grid();
+    t0 = now_ms();
+    bool loaded = load(0, *world, player);
+    printf("  load                 %9.2f ms\n", now_ms() - t0);
+
+    bool blocks_match = loaded;
+    for(int y = 0; y < WORLD_HEIGHT && blocks_match; y++)
+        blocks_match = memcmp(blocks[y], world->slice_blocks(y), SLICE_SIZE) == 0;
+
+    if(!blocks_match)
+        printf("  loaded blocks do NOT match the saved ones\n");
+    else if(!grid_matches(saved))
+        printf("  loaded grid does NOT match the saved one\n");
+}
+
+// Generates the biggest map, then walks the player across it and back so the
+// window pages out to the far edge and returns. A block placed before setting
+// off, and the triangle grid, have to come back as they were
+static void bench_map() {
+    printf("== %dx%d map\n", MAX_MAP_CHUNKS * CHUNK_SIZE, MAX_MAP_CHUNKS * CHUNK_SIZE);
+
+    world->clear_world();
+    world->init_tri_grid();
+    srandom(1);
+
+    memset(&host_fileioc_stats, 0, sizeof(host_fileioc_stats));
+    double t0 = now_ms();
+    bool made = generate_map(1, *world, player, NATURAL_WORLD, MAX_MAP_CHUNKS);
+    printf("  generate             %9.2f ms  %7lu bytes archived\n",
+           now_ms() - t0, (unsigned long)host_fileioc_stats.bytes_archived);
+    if(!made) {
+        printf("  map could NOT be saved\n");
+        return;
+    }
+
+    world->place_block(WORLD_SIZE / 2, WORLD_HEIGHT - 1, WORLD_SIZE / 2, GOLD);
+    world->build_tri_grid();
+
+    static Block_t blocks[WORLD_HEIGHT][SLICE_SIZE];
+    for(int y = 0; y < WORLD_HEIGHT; y++)
+        memcpy(blocks[y], world->slice_blocks(y), SLICE_SIZE);
+    static uint8_t grid[4][TRI_CNT];
+    snapshot_grid(grid);
+    uint8_t window_x = world->window_x;
+    uint8_t window_z = world->window_z;
+
+    stat_t pages = {};
+    memset(&host_fileioc_stats, 0, sizeof(host_fileioc_stats));
+
+    // Out along +x, back, out along +z, back
+    const int moves[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+    for(int leg = 0; leg < 4; leg++) {
+        for(int step = 0; step < MAX_MAP_CHUNKS * CHUNK_SIZE / 2; step++) {
+            int x = player.x + moves[leg][0];
+            int z = player.z + moves[leg][1];
+            if(x < 0 || x >= WORLD_SIZE || z < 0 || z >= WORLD_SIZE) break;
+            player.x = x;
+            player.z = z;
+
+            t0 = now_ms();
+            if(follow_player(1, *world, player))
+                pages.add(now_ms() - t0);
+        }
+    }
+
+    printf("  page window          %9.2f ms  (max %.2f ms over %u pages, %lu bytes archived)\n",
+           pages.mean(), pages.max, (unsigned)pages.cnt, (unsigned long)host_fileioc_stats.bytes_archived);
+
+    bool blocks_match = world->window_x == window_x && world->window_z == window_z;
+    for(int y = 0; y < WORLD_HEIGHT && blocks_match; y++)
+        blocks_match = memcmp(blocks[y], world->slice_blocks(y), SLICE_SIZE) == 0;
+
+    if(!blocks_match)
+        printf("  paged blocks do NOT match the originals\n");
+    else if(!grid_matches(grid))
+        printf("  paged grid does NOT match the original\n");
+
+    // The window's place on the map is saved with it
+    save(1, *world, player);
+    world->clear_world();
+    if(!load(1, *world, player) || world->map_chunks != MAX_MAP_CHUNKS ||
+       world->window_x != window_x || world->window_z != window_z)
+        printf("  loaded map does NOT match the saved one\n");
+
+    erase(1);
+}
+
+// The scans as they were first written, unprojecting every depth and reading
+// every block, to check the faster ones against
+static bool ref_scan_tri(int row, int idx, int depth, uint8_t &x, uint8_t &y, uint8_t &z, Block_t skip) {
+    while(true) {
+        world->unproject(row, idx, depth, x, y, z);
+        if(x >= WORLD_SIZE || y >= WORLD_HEIGHT || z >= WORLD_SIZE) return false;
+        if(world->block_at(x, y, z) > skip) return true;
+        depth++;
+    }
+}
+
+static bool ref_scan_shadow(int row, int idx, int depth, uint8_t &x, uint8_t &y, uint8_t &z) {
+    while(true) {
+        uint8_t sx, sy, sz;
+        world->unproject(row, idx, depth, sx, sy, sz);
+        if(sx >= WORLD_SIZE || sy >= WORLD_HEIGHT || sz >= WORLD_SIZE) return false;
+        from_shadow_space(sx, sy, sz, x, y, z);
+        if(world->block_at(x, y, z) > WATER) return true;
+        depth++;
+    }
+}
+
+// Runs scan_tri and scan_shadow from every triangle at every depth and
+// checks they find the same blocks as the reference versions
+static void check_scans() {
+    uint32_t scans = 0;
+    uint32_t mismatches = 0;
+
+    for(int row = 0; row < ROW_CNT; row++) {
+        for(int idx = 0; idx < (int)tri_geometry.row_width[row]; idx++) {
+            for(int depth = 0; depth < 256; depth++) {
+                uint8_t x, y, z, ref_x, ref_y, ref_z;
+                for(int i = 0; i < 2; i++) {
+                    Block_t skip = i ? WATER : AIR;
+                    bool hit = world->scan_tri(row, idx, depth, x, y, z, skip);
+                    bool ref_hit = ref_scan_tri(row, idx, depth, ref_x, ref_y, ref_z, skip);
+                    if(hit != ref_hit || x != ref_x || y != ref_y || z != ref_z)
+                        mismatches++;
+                }
+
+                // The shadow scan leaves its position alone when it misses
+                x = y = z = ref_x = ref_y = ref_z = 0;
+                bool hit = world->scan_shadow(row, idx, depth, x, y, z);
+                bool ref_hit = ref_scan_shadow(row, idx, depth, ref_x, ref_y, ref_z);
+                if(hit != ref_hit || x != ref_x || y != ref_y || z != ref_z)
+                    mismatches++;
+
+                scans += 3;
+            }
+        }
+    }
+
+    printf("  scan check           %9lu scans\n", (unsigned long)scans);
+    if(mismatches)
+        printf("  %lu scans do NOT match the reference\n", (unsigned long)mismatches);
+}
+
+// The block bench_batch() puts at each position of its box
+static Block_t batch_block(int x, int y, int z) {
+    switch((x + 2 * y + 3 * z) % 5) {
+    case 0: return AIR;
+    case 1: return WATER;
+    default: return STONE;
+    }
+}
+
+// Changes a 10x10x10 box of blocks in one batch, checks the grid matches a
+// full rebuild, then puts the blocks back. Compares that with making the same
+// changes one place_block or remove_block at a time
+static void bench_batch() {
+    const int lo = WORLD_SIZE / 2 - 5;
+    const int y_lo = 3;
+    const int size = 10;
+
+    static Block_t saved[size][size][size];
+    for(int x = 0; x < size; x++)
+        for(int y = 0; y < size; y++)
+            for(int z = 0; z < size; z++)
+                saved[x][y][z] = world->block_at(lo + x, y_lo + y, lo + z);
+
+    static uint8_t before[4][TRI_CNT];
+    snapshot_grid(before);
+    full_redraw();
+
+    double t0 = now_ms();
+    world->begin_edit();
+    for(int x = 0; x < size; x++)
+        for(int y = 0; y < size; y++)
+            for(int z = 0; z < size; z++)
+                world->edit_block(lo + x, y_lo + y, lo + z, batch_block(x, y, z));
+    world->commit_edit();
+    draw_dirty_tris(*world);
+    double batch_ms = now_ms() - t0;
+
+    // The one redraw has to catch every triangle that changed
+    uint32_t batch_hash = fnv1a(VRAM, LCD_CNT);
+    full_redraw();
+    if(fnv1a(VRAM, LCD_CNT) != batch_hash)
+        printf("  batch redraw does NOT match a full redraw\n");
+
+    static uint8_t batched[4][TRI_CNT];
+    snapshot_grid(batched);
+#ifdef TRI_RUNS
+    static uint8_t runs[sizeof(world->tri_grid_run)];
+    memcpy(runs, world->tri_grid_run, sizeof(runs));
+#endif
+    world->build_tri_grid();
+    bool match = grid_matches(batched);
+#ifdef TRI_RUNS
+    match = match && memcmp(runs, world->tri_grid_run, sizeof(runs)) == 0;
+#endif
+
+    // Put everything back as a batch too
+    world->begin_edit();
+    for(int x = 0; x < size; x++)
+        for(int y = 0; y < size; y++)
+            for(int z = 0; z < size; z++)
+                world->edit_block(lo + x, y_lo + y, lo + z, saved[x][y][z]);
+    world->commit_edit();
+    draw_dirty_tris(*world);
+    match = match && grid_matches(before);
+
+    // And the same changes one block at a time
+    t0 = now_ms();
+    for(int x = 0; x < size; x++) {
+        for(int y = 0; y < size; y++) {
+            for(int z = 0; z < size; z++) {
+                Block_t block = batch_block(x, y, z);
+                if(world->block_at(lo + x, y_lo + y, lo + z) == block) continue;
+                if(world->block_at(lo + x, y_lo + y, lo + z) != AIR)
+                    world->remove_block(lo + x, y_lo + y, lo + z);
+                if(block == WATER)
+                    world->set_water(lo + x, y_lo + y, lo + z);
+                else if(block != AIR)
+                    world->place_block(lo + x, y_lo + y, lo + z, block);
+            }
+        }
+    }
+    draw_dirty_tris(*world);
+    double single_ms = now_ms() - t0;
+    bool single_match = grid_matches(batched);
+
+    world->begin_edit();
+    for(int x = 0; x < size; x++)
+        for(int y = 0; y < size; y++)
+            for(int z = 0; z < size; z++)
+                world->edit_block(lo + x, y_lo + y, lo + z, saved[x][y][z]);
+    world->commit_edit();
+    world->clear_dirty();
+    match = match && grid_matches(before);
+
+    printf("  batch edit           %9.2f ms  %7.2f ms one at a time  (%d blocks)\n",
+           batch_ms, single_ms, size * size * size);
+    if(!match)
+        printf("  batch edit does NOT match a rebuild\n");
+    if(!single_match)
+        printf("  single edits do NOT match the batch\n");
+}
+
+static void bench_world(const char *source, int passes, const char *ppm) {
+    if(!setup_world(source)) return;
+
+    printf("== %s\n", source);
+
+    double t0 = now_ms();
+    build_world();
+    printf("  build world          %9.2f ms\n", now_ms() - t0);
+    world->clear_dirty();
+
+    clear_tri_cache();
+
+    // Full screen redraws
+    bench_px_written = 0;
+    t0 = now_ms();
+    for(int i = 0; i < passes; i++)
+        full_redraw();
+    double t = now_ms() - t0;
+    printf("  draw_tri_grid        %9.1f fps  %7lu px/frame\n",
+           passes * 1000.0 / t, (unsigned long)(bench_px_written / passes));
+    report_cache();
+
+    // Scripted scrolling
+    int steps = 0;
+    bench_px_written = 0;
+    t0 = now_ms();
+    for(int i = 0; i < passes; i++) {
+        for(auto &seg : scroll_script) {
+            for(int s = 0; s < seg[0]; s++) {
+                scroll_view(*world, seg[1], seg[2]);
+                steps++;
+            }
+        }
+    }
+    t = now_ms() - t0;
+    printf("  scroll_view          %9.1f fps  %7lu px/frame\n",
+           steps * 1000.0 / t, (unsigned long)(bench_px_written / steps));
+    report_cache();
+    uint32_t scroll_hash = fnv1a(VRAM, LCD_CNT);
+
+    // Scripted edits: dig out the top block of a grid of columns and then put
+    // it back, repainting the changed triangles after each edit like play() does
+    stat_t remove_stat = {}, place_stat = {}, redraw_stat = {};
+    full_redraw();
+    bench_px_written = 0;
+    for(int x = 1; x < WORLD_SIZE; x += 3) {
+        for(int z = 2; z < WORLD_SIZE; z += 3) {
+            int y = WORLD_HEIGHT - 1;
+            while(y >= 0 && world->block_at(x, y, z) == AIR) y--;
+            if(y < 0) continue;
+            Block_t block = world->block_at(x, y, z);
+
+            world->mark_block_dirty(x, y, z);
+            t0 = now_ms();
+            world->remove_block(x, y, z);
+            remove_stat.add(now_ms() - t0);
+            t0 = now_ms();
+            draw_dirty_tris(*world);
+            redraw_stat.add(now_ms() - t0);
+
+            world->mark_block_dirty(x, y, z);
+            t0 = now_ms();
+            if(block == WATER) {
+                world->set_water(x, y, z);
+            }
+            else {
+                world->place_block(x, y, z, block);
+            }
+            place_stat.add(now_ms() - t0);
+            t0 = now_ms();
+            draw_dirty_tris(*world);
+            redraw_stat.add(now_ms() - t0);
+        }
+    }
+    printf("  remove_block         %9.4f ms  max %8.4f ms  (%u edits)\n",
+           remove_stat.mean(), remove_stat.max, remove_stat.cnt);
+    printf("  place_block          %9.4f ms  max %8.4f ms  (%u edits)\n",
+           place_stat.mean(), place_stat.max, place_stat.cnt);
+    printf("  edit redraw          %9.4f ms  max %8.4f ms  %5lu px/edit\n",
+           redraw_stat.mean(), redraw_stat.max,
+           (unsigned long)(redraw_stat.cnt ? bench_px_written / redraw_stat.cnt : 0));
+
+    // The edits only repainted what changed, so a full repaint must match
+    uint32_t edit_hash = fnv1a(VRAM, LCD_CNT);
+    full_redraw();
+    if(fnv1a(VRAM, LCD_CNT) != edit_hash)
+        printf("  edit redraw does NOT match a full redraw\n");
+
+    // After all those edits the column heights have to still be right too
+    check_scans();
+
+    static uint8_t planes[4][TRI_CNT];
+    snapshot_grid(planes);
+    uint32_t grid_hash = fnv1a(planes[0], sizeof(planes));
+
+    // Editing one block at a time has to end up where building from scratch does
+    world->build_tri_grid();
+    if(!grid_matches(planes))
+        printf("  edited grid does NOT match a rebuild\n");
+
+    printf("  scroll vram hash     %08x\n", scroll_hash);
+    printf("  edit vram hash       %08x\n", edit_hash);
+    printf("  grid hash            %08x\n", grid_hash);
+
+    bench_save_load();
+
+    if(ppm) write_ppm(ppm);
+
+    bench_batch();
+}
+
+int main(int argc, char **argv) {
+    int passes = 100;
+    bool ppm = false;
+    int first = 1;
+
+    while(first < argc && argv[first][0] == '-') {
+        if(strcmp(argv[first], "-n") == 0 && first + 1 < argc) {
+            passes = atoi(argv[first + 1]);
+            first += 2;
+        }
+        else if(strcmp(argv[first], "-p") == 0) {
+            ppm = true;
+            first++;
+        }
+        else {
+            fprintf(stderr, "usage: bench [-n passes] [-p] [world_dir | natural | flat | demo]...\n");
+            return 1;
+        }
+    }
+    if(passes < 1) passes = 1;
+
+    init_palette();
+
+    const char *defaults[] = { "worlds/Village", "natural" };
+    const char **sources = (first < argc) ? (const char**)&argv[first] : defaults;
+    int source_cnt = (first < argc) ? argc - first : 2;
+
+    for(int i = 0; i < source_cnt; i++) {
+        char path[32];
+        snprintf(path, sizeof(path), "bench_%d.ppm", i);
+        bench_world(sources[i], passes, ppm ? path : NULL);
+    }
+
+    bench_map();
+
+    return 0;
+}
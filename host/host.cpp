@@ -0,0 +1,270 @@
+// Host implementations of the CE library calls used by the game, plus the
+// emulated calculator memory the game addresses directly.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <tice.h>
+#include <graphx.h>
+#include <fileioc.h>
+
+// -------- Memory --------
+// RAM (SafeRAM and both VRAM buffers) and the LCD controller
+// page (palette) are mapped at the same addresses as on the calculator, so the
+// hard-coded pointers in the game work unmodified.
+
+#define HOST_RAM_BASE 0xD00000
+#define HOST_RAM_SIZE 0x66000
+#define HOST_LCD_BASE 0xE30000
+#define HOST_LCD_SIZE 0x1000
+
+static void map_fixed(uintptr_t base, size_t size) {
+    void *p = mmap((void*)base, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if(p != (void*)base) {
+        fprintf(stderr, "host: could not map 0x%lx (%zu bytes)\n", (unsigned long)base, size);
+        exit(1);
+    }
+}
+
+__attribute__((constructor))
+void host_map_memory(void) {
+    static bool mapped = false;
+    if(mapped) return;
+    mapped = true;
+
+    map_fixed(HOST_RAM_BASE, HOST_RAM_SIZE);
+    map_fixed(HOST_LCD_BASE, HOST_LCD_SIZE);
+
+    // Nothing ever clears the LCD's raw interrupt status here, so leave the
+    // base update flag set and waits for the next refresh return immediately
+    *(volatile uint8_t*)(HOST_LCD_BASE + 0x20) = 4;
+}
+
+// -------- tice --------
+
+sk_key_t os_GetCSC(void) {
+    return 0;
+}
+
+// -------- graphx --------
+
+void gfx_Begin(void) {}
+void gfx_End(void) {}
+void gfx_SetDrawScreen(void) {}
+void gfx_SetDrawBuffer(void) {}
+void gfx_SwapDraw(void) {}
+void gfx_FillScreen(uint8_t) {}
+uint8_t gfx_SetColor(uint8_t) { return 0; }
+uint8_t gfx_SetTextFGColor(uint8_t) { return 0; }
+void gfx_FillRectangle(int24_t, int24_t, int24_t, int24_t) {}
+void gfx_Rectangle(int24_t, int24_t, int24_t, int24_t) {}
+void gfx_PrintStringXY(const char*, int24_t, int24_t) {}
+
+// -------- fileioc --------
+
+struct host_var {
+    std::vector<uint8_t> data;
+    bool archived;
+};
+
+struct host_slot {
+    bool open;
+    std::string name;
+    size_t offset;
+};
+
+#define HOST_SLOT_CNT 5
+
+static std::map<std::string, host_var> vars;
+static host_slot slots[HOST_SLOT_CNT + 1];
+
+host_fileioc_stats_t host_fileioc_stats;
+
+static host_var *slot_var(ti_var_t slot) {
+    if(slot == 0 || slot > HOST_SLOT_CNT || !slots[slot].open) return NULL;
+    auto it = vars.find(slots[slot].name);
+    return it == vars.end() ? NULL : &it->second;
+}
+
+ti_var_t ti_Open(const char *name, const char *mode) {
+    ti_var_t slot = 0;
+    for(ti_var_t i = 1; i <= HOST_SLOT_CNT; i++) {
+        if(!slots[i].open) {
+            slot = i;
+            break;
+        }
+    }
+    if(slot == 0) return 0;
+
+    auto it = vars.find(name);
+    if(mode[0] == 'r') {
+        if(it == vars.end()) return 0;
+    }
+    else if(mode[0] == 'w') {
+        vars[name] = host_var{ {}, false };
+    }
+    else if(mode[0] == 'a') {
+        if(it == vars.end()) vars[name] = host_var{ {}, false };
+    }
+    else {
+        return 0;
+    }
+
+    slots[slot].open = true;
+    slots[slot].name = name;
+    slots[slot].offset = (mode[0] == 'a') ? vars[name].data.size() : 0;
+    return slot;
+}
+
+int ti_Close(ti_var_t slot) {
+    if(slot == 0 || slot > HOST_SLOT_CNT) return 0;
+    slots[slot].open = false;
+    return 1;
+}
+
+size_t ti_Write(const void *data, size_t size, size_t count, ti_var_t slot) {
+    host_var *var = slot_var(slot);
+    if(var == NULL || var->archived) return 0;
+    size_t len = size * count;
+    size_t &offset = slots[slot].offset;
+    if(offset + len > var->data.size())
+        var->data.resize(offset + len);
+    memcpy(&var->data[offset], data, len);
+    offset += len;
+    host_fileioc_stats.bytes_written += len;
+    return count;
+}
+
+size_t ti_Read(void *data, size_t size, size_t count, ti_var_t slot) {
+    host_var *var = slot_var(slot);
+    if(var == NULL || size == 0) return 0;
+    size_t &offset = slots[slot].offset;
+    size_t avail = (var->data.size() - offset) / size;
+    if(count > avail) count = avail;
+    memcpy(data, &var->data[offset], size * count);
+    offset += size * count;
+    return count;
+}
+
+int ti_PutC(char c, ti_var_t slot) {
+    return ti_Write(&c, 1, 1, slot) == 1 ? (uint8_t)c : EOF;
+}
+
+int ti_GetC(ti_var_t slot) {
+    uint8_t c;
+    return ti_Read(&c, 1, 1, slot) == 1 ? c : EOF;
+}
+
+int ti_Seek(int24_t offset, unsigned int origin, ti_var_t slot) {
+    host_var *var = slot_var(slot);
+    if(var == NULL) return EOF;
+    int24_t base = 0;
+    if(origin == SEEK_CUR) base = slots[slot].offset;
+    if(origin == SEEK_END) base = var->data.size();
+    if(base + offset < 0 || base + offset > (int24_t)var->data.size()) return EOF;
+    slots[slot].offset = base + offset;
+    return 0;
+}
+
+uint16_t ti_Tell(ti_var_t slot) {
+    return slot_var(slot) ? slots[slot].offset : 0;
+}
+
+uint16_t ti_GetSize(ti_var_t slot) {
+    host_var *var = slot_var(slot);
+    return var ? var->data.size() : 0;
+}
+
+int ti_Resize(size_t size, ti_var_t slot) {
+    host_var *var = slot_var(slot);
+    if(var == NULL || var->archived) return -1;
+    var->data.resize(size);
+    if(slots[slot].offset > size) slots[slot].offset = size;
+    return size;
+}
+
+int ti_Rewind(ti_var_t slot) {
+    return ti_Seek(0, SEEK_SET, slot);
+}
+
+void *ti_GetDataPtr(ti_var_t slot) {
+    host_var *var = slot_var(slot);
+    if(var == NULL) return NULL;
+    return var->data.data() + slots[slot].offset;
+}
+
+int ti_SetArchiveStatus(bool archived, ti_var_t slot) {
+    host_var *var = slot_var(slot);
+    if(var == NULL) return 0;
+    if(archived && !var->archived) {
+        host_fileioc_stats.bytes_archived += var->data.size();
+        host_fileioc_stats.archive_writes++;
+    }
+    var->archived = archived;
+    return 1;
+}
+
+bool ti_IsArchived(ti_var_t slot) {
+    host_var *var = slot_var(slot);
+    return var ? var->archived : false;
+}
+
+int ti_Delete(const char *name) {
+    return vars.erase(name) ? 1 : 0;
+}
+
+uint8_t ti_Rename(const char *old_name, const char *new_name) {
+    if(vars.count(new_name)) return 1;
+    auto it = vars.find(old_name);
+    if(it == vars.end()) return 2;
+    vars[new_name] = it->second;
+    vars.erase(it);
+    return 0;
+}
+
+// Pulls the application variable out of a single .8xv file
+static bool load_8xv(const std::string &path) {
+    FILE *f = fopen(path.c_str(), "rb");
+    if(f == NULL) return false;
+    std::vector<uint8_t> file;
+    uint8_t buf[4096];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        file.insert(file.end(), buf, buf + n);
+    fclose(f);
+
+    // 55 byte file header, then the variable entry:
+    // [2: entry type][2: data len][1: type][8: name][1: version][1: flags][2: data len]
+    // followed by the appvar's own 2 byte size prefix and its contents
+    if(file.size() < 74 || memcmp(file.data(), "**TI83F*", 8) != 0) return false;
+
+    char name[9] = { 0 };
+    memcpy(name, &file[60], 8);
+    size_t size = file[72] | (file[73] << 8);
+    if(file.size() < 74 + size) return false;
+
+    host_var var;
+    var.data.assign(file.begin() + 74, file.begin() + 74 + size);
+    var.archived = (file[69] & 0x80) != 0;
+    vars[name] = var;
+    return true;
+}
+
+int host_load_vars(const char *dir) {
+    DIR *d = opendir(dir);
+    if(d == NULL) return 0;
+    int cnt = 0;
+    struct dirent *ent;
+    while((ent = readdir(d)) != NULL) {
+        std::string file = ent->d_name;
+        if(file.size() > 4 && file.compare(file.size() - 4, 4, ".8xv") == 0)
+            cnt += load_8xv(std::string(dir) + "/" + file);
+    }
+    closedir(d);
+    return cnt;
+}
@@ -0,0 +1,5 @@
+#pragma once
+// Host stand-in for the CE toolchain's <debug.h>
+#include <stdio.h>
+
+#define dbg_printf(...) fprintf(stderr, __VA_ARGS__)
@@ -0,0 +1,46 @@
+#pragma once
+// Host stand-in for the CE toolchain's <fileioc.h>. Variables live in memory;
+// host_load_vars() seeds them from a directory of .8xv files.
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef uint8_t ti_var_t;
+
+#ifndef EOF
+#define EOF (-1)
+#endif
+#ifndef SEEK_SET
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
+#endif
+
+ti_var_t ti_Open(const char *name, const char *mode);
+int ti_Close(ti_var_t slot);
+int ti_PutC(char c, ti_var_t slot);
+int ti_GetC(ti_var_t slot);
+size_t ti_Write(const void *data, size_t size, size_t count, ti_var_t slot);
+size_t ti_Read(void *data, size_t size, size_t count, ti_var_t slot);
+int ti_Seek(int24_t offset, unsigned int origin, ti_var_t slot);
+uint16_t ti_Tell(ti_var_t slot);
+uint16_t ti_GetSize(ti_var_t slot);
+int ti_Resize(size_t size, ti_var_t slot);
+int ti_Rewind(ti_var_t slot);
+void *ti_GetDataPtr(ti_var_t slot);
+int ti_SetArchiveStatus(bool archived, ti_var_t slot);
+bool ti_IsArchived(ti_var_t slot);
+int ti_Delete(const char *name);
+uint8_t ti_Rename(const char *old_name, const char *new_name);
+
+// Loads every .8xv application variable in a directory into the variable store
+int host_load_vars(const char *dir);
+
+// Running totals used by the benchmark to report save costs
+typedef struct host_fileioc_stats {
+    size_t bytes_written;
+    size_t bytes_archived;
+    size_t archive_writes;
+} host_fileioc_stats_t;
+
+extern host_fileioc_stats_t host_fileioc_stats;
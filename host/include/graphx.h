@@ -0,0 +1,19 @@
+#pragma once
+// Host stand-in for the CE toolchain's <graphx.h>. The game draws the play
+// field straight into VRAM, so the graphx calls only need to exist; they are
+// used for the UI, which the benchmark never shows.
+#include <stdint.h>
+
+#define gfx_RGBTo1555(r, g, b) ((uint16_t)((((r) >> 3) << 10) | (((g) >> 3) << 5) | ((b) >> 3)))
+
+void gfx_Begin(void);
+void gfx_End(void);
+void gfx_SetDrawScreen(void);
+void gfx_SetDrawBuffer(void);
+void gfx_SwapDraw(void);
+void gfx_FillScreen(uint8_t index);
+uint8_t gfx_SetColor(uint8_t index);
+uint8_t gfx_SetTextFGColor(uint8_t color);
+void gfx_FillRectangle(int24_t x, int24_t y, int24_t width, int24_t height);
+void gfx_Rectangle(int24_t x, int24_t y, int24_t width, int24_t height);
+void gfx_PrintStringXY(const char *string, int24_t x, int24_t y);
@@ -0,0 +1,16 @@
+#pragma once
+// Force-included into every translation unit of the host benchmark build.
+// Supplies the eZ80 integer types the CE toolchain provides natively, and the
+// hooks used to emulate the parts of the calculator address space the game
+// touches directly (VRAM, SafeRAM and the LCD palette).
+#include <stdint.h>
+#include <stddef.h>
+
+// The game casts freely between pointers and int24_t/uint24_t, so on the host
+// they have to be pointer sized rather than 24 bits wide
+typedef intptr_t int24_t;
+typedef uintptr_t uint24_t;
+
+// Maps the emulated RAM and LCD controller regions at their calculator
+// addresses. Called automatically before main().
+void host_map_memory(void);
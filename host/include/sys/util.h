@@ -0,0 +1,5 @@
+#pragma once
+// Host stand-in for the CE toolchain's <sys/util.h>
+#include <stdlib.h>
+
+#define randInt(min, max) ((unsigned)random() % ((max) - (min) + 1) + (min))
@@ -0,0 +1,31 @@
+#pragma once
+// Host stand-in for the CE toolchain's <tice.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define LCD_WIDTH 320
+#define LCD_HEIGHT 240
+
+typedef uint8_t sk_key_t;
+
+#define sk_Down  0x01
+#define sk_Left  0x02
+#define sk_Right 0x03
+#define sk_Up    0x04
+#define sk_Enter 0x09
+#define sk_Sub   0x0B
+#define sk_Mul   0x0C
+#define sk_3     0x12
+#define sk_6     0x13
+#define sk_9     0x14
+#define sk_2     0x1A
+#define sk_5     0x1B
+#define sk_8     0x1C
+#define sk_1     0x22
+#define sk_4     0x23
+#define sk_7     0x24
+#define sk_2nd   0x36
+#define sk_Del   0x38
+
+// Always reports that no key is pressed
+sk_key_t os_GetCSC(void);
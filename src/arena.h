@@ -0,0 +1,92 @@
+#pragma once
+#include <tice.h>
+#include <stdint.h>
+
+// -------- RAM Map --------
+// The parts of the calculator's RAM the game addresses directly. See
+// https://wikiti.brandonw.net/index.php?title=Category:84PCE:RAM:By_Address
+
+// The contiguous 69K of Safe RAM, up to where the OS's own variables start
+#define SAFE_RAM 0xD031F6
+#define SAFE_RAM_SIZE 69090
+#define SAFE_RAM_END 0xD13FD8
+
+// The toolchain keeps the program's zero initialised variables (BSS) and its
+// heap between these two addresses, which by default take up most of Safe
+// RAM. The makefile moves them to a small block at the start of it and
+// passes the bounds in, leaving the rest for the arena
+#ifndef BSSHEAP_LOW
+#define BSSHEAP_LOW 0xD031F6
+#endif
+#ifndef BSSHEAP_HIGH
+#define BSSHEAP_HIGH 0xD039F6
+#endif
+
+// Where the OS loads programs. The program, its variables, the heap, any
+// variables the OS creates in RAM and the symbol table all share the space
+// from here up to VRAM, so nothing can be placed there by address
+#define USER_MEM 0xD1A881
+
+// The two halves of VRAM the game double buffers between
+#define BUFFER_1 0xD40000
+#define BUFFER_2 0xD52C00
+#define BUFFER_SIZE (LCD_WIDTH * LCD_HEIGHT)
+
+// -------- Arenas --------
+// An arena is a region of RAM the OS leaves alone while the game runs. Each
+// block in it is placed directly after the last, so every address is worked
+// out by the compiler and can be checked against the rest of the map before
+// anything runs
+
+typedef struct ram_block {
+    uint24_t base;
+    uint24_t size;
+} ram_block_t;
+
+constexpr uint24_t block_end(ram_block_t block) {
+    return block.base + block.size;
+}
+
+// The first block of an arena
+constexpr ram_block_t arena_first(ram_block_t arena, uint24_t size) {
+    return {arena.base, size};
+}
+
+// The block of a given size placed after prev, aligned to align bytes
+constexpr ram_block_t arena_next(ram_block_t prev, uint24_t size, uint24_t align) {
+    return {(block_end(prev) + align - 1) / align * align, size};
+}
+
+// Whatever is left of an arena after prev, aligned to align bytes
+constexpr ram_block_t arena_rest(ram_block_t arena, ram_block_t prev, uint24_t align) {
+    return arena_next(prev, block_end(arena) - (block_end(prev) + align - 1) / align * align, align);
+}
+
+constexpr bool block_within(ram_block_t block, ram_block_t arena) {
+    return block.base >= arena.base && block_end(block) <= block_end(arena);
+}
+
+constexpr bool blocks_overlap(ram_block_t a, ram_block_t b) {
+    return a.base < block_end(b) && b.base < block_end(a);
+}
+
+constexpr ram_block_t SAFE_RAM_BLOCK = {SAFE_RAM, SAFE_RAM_SIZE};
+constexpr ram_block_t BSS_HEAP_RAM = {BSSHEAP_LOW, BSSHEAP_HIGH - BSSHEAP_LOW};
+
+// Everything in Safe RAM after the program's variables and heap
+constexpr ram_block_t SAFE_RAM_ARENA = {block_end(BSS_HEAP_RAM), SAFE_RAM_END - block_end(BSS_HEAP_RAM)};
+
+static_assert(block_end(SAFE_RAM_BLOCK) == SAFE_RAM_END, "Safe RAM ends where the OS's variables start");
+static_assert(BSS_HEAP_RAM.base == SAFE_RAM && block_within(BSS_HEAP_RAM, SAFE_RAM_BLOCK),
+              "The program's variables and heap have to sit at the start of Safe RAM");
+static_assert(block_end(SAFE_RAM_ARENA) == SAFE_RAM_END, "The arena must stop at the end of Safe RAM");
+
+// Regions that belong to someone else
+constexpr ram_block_t OS_RAM = {USER_MEM, BUFFER_1 - USER_MEM};
+constexpr ram_block_t BUFFER_1_RAM = {BUFFER_1, BUFFER_SIZE};
+constexpr ram_block_t BUFFER_2_RAM = {BUFFER_2, BUFFER_SIZE};
+
+static_assert(!blocks_overlap(SAFE_RAM_BLOCK, OS_RAM), "Safe RAM must not reach the OS's memory");
+static_assert(!blocks_overlap(SAFE_RAM_BLOCK, BUFFER_1_RAM) && !blocks_overlap(SAFE_RAM_BLOCK, BUFFER_2_RAM),
+              "Safe RAM must not reach VRAM");
+static_assert(!blocks_overlap(BUFFER_1_RAM, BUFFER_2_RAM), "The two frame buffers must not overlap");
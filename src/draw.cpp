@@ -10,6 +10,12 @@ uint8_t* buffer2 = (uint8_t*)BUFFER_2;
 
 uint8_t* VRAM = buffer1;
 
+// The address the LCD controller displays from
+volatile uint24_t* lcd_base = (uint24_t*)0xE30010;
+// The LCD controller's raw interrupt status, and the register to clear it
+volatile uint8_t* lcd_ris = (uint8_t*)0xE30020;
+volatile uint8_t* lcd_icr = (uint8_t*)0xE30028;
+
 int24_t scroll_x = 0;
 int24_t scroll_y = 0;
 
@@ -19,31 +25,88 @@ uint16_t draw_y0 = 0;
 uint16_t draw_x1 = LCD_WIDTH;
 uint16_t draw_y1 = LCD_HEIGHT;
 
+// Rows that triangles are clipped to. Only narrowed while a frame is drawn in
+// parts, so no triangle spills out of its part into memory on screen
+int24_t clip_y0 = 0;
+int24_t clip_y1 = LCD_HEIGHT;
+
+#ifdef BENCH
+uint24_t bench_px_written = 0;
+#endif
+
+#ifdef PERF_HUD
+uint32_t perf_cycles[PERF_CNT];
+#endif
+
+// The triangle cache sits directly after the world in Safe RAM
+tri_cache_t *tri_cache = (tri_cache_t*)TRI_CACHE_RAM.base;
+
+uint24_t tri_cache_hits = 0;
+uint24_t tri_cache_misses = 0;
+
 
 // Copies pixels from a texture line into a VRAM line, applying a constant mask across all pixels
 // In this case, the texture can be transparent, with blank pixels represented as a zero
 void copy_tex_line(uint8_t *dest, uint8_t *tex, uint8_t flags, int length) {
     for(int i = 0; i < length; i++) {
-        if(tex[i])
+        if(tex[i]) {
             dest[i] = tex[i] | flags;
+            COUNT_PX(1);
+        }
     }
 }
 
 // Copies pixels from a texture line into a VRAM line, along with applying shadow and water mask terms
 void copy_tex_line(uint8_t *dest, uint8_t *tex, uint8_t *shadow_mask, uint8_t *water_mask, int length) {
+    COUNT_PX(length);
     for(int i = 0; i < length; i++) {
         dest[i] = tex[i] | shadow_mask[i] | water_mask[i];
     }
 }
 
+// Copies pixels from a texture line into a VRAM line, ORing the same mask byte into every pixel
+void copy_tex_line_const(uint8_t *dest, uint8_t *tex, uint8_t mask, int length) {
+    COUNT_PX(length);
+    for(int i = 0; i < length; i++) {
+        dest[i] = tex[i] | mask;
+    }
+}
+
 // Copies SKY colored pixels with the water mask applied into a VRAM line
 void copy_tex_line(uint8_t *dest, uint8_t *water_mask, int length) {
+    COUNT_PX(length);
     for(int i = 0; i < length; i++) {
         dest[i] = SKY | water_mask[i];
     }
 }
 
 
+// Copies a line of an already composited triangle into a VRAM line
+void copy_tri_line(uint8_t *dest, uint8_t *tri, int length) {
+    COUNT_PX(length);
+    memcpy(dest, tri, length);
+}
+
+
+// Returns the byte a shadow and water mask pair ORs into every pixel when both
+// are constant (empty, full_shadow or full_water), or -1 if either one varies
+int24_t constant_mask(uint8_t *shadow_mask, uint8_t *water_mask) {
+    int24_t mask = 0;
+
+    if(shadow_mask == full_shadow)
+        mask |= SHADOW;
+    else if(shadow_mask != empty)
+        return -1;
+
+    if(water_mask == full_water)
+        mask |= UNDERWATER;
+    else if(water_mask != empty)
+        return -1;
+
+    return mask;
+}
+
+
 // Draws a left facing triangle and checks every pixel to ensure nothing gets drawn out of bounds
 void draw_left_triangle_clipped(int24_t x0, int24_t y0, uint8_t *tex, uint8_t *shadow_mask, uint8_t *water_mask) {
     for(int row = 1; row <= 8; row++) {
@@ -52,8 +115,10 @@ void draw_left_triangle_clipped(int24_t x0, int24_t y0, uint8_t *tex, uint8_t *s
 
             int24_t dy = (row - 1 + y0);
 
-            if(dy >= 0 && dy < LCD_HEIGHT && dx >= 0 && dx < LCD_WIDTH)
+            if(dy >= clip_y0 && dy < clip_y1 && dx >= 0 && dx < LCD_WIDTH) {
                 VRAM[LCD_WIDTH * dy + dx] = color;
+                COUNT_PX(1);
+            }
         }
     }
 
@@ -63,8 +128,10 @@ void draw_left_triangle_clipped(int24_t x0, int24_t y0, uint8_t *tex, uint8_t *s
 
             int24_t dy = (8 + row - 1 + y0);
 
-            if(dy >= 0 && dy < LCD_HEIGHT && dx >= 0 && dx < LCD_WIDTH)
+            if(dy >= clip_y0 && dy < clip_y1 && dx >= 0 && dx < LCD_WIDTH) {
                 VRAM[LCD_WIDTH * dy + dx] = color;
+                COUNT_PX(1);
+            }
         }
     }
 }
@@ -77,8 +144,10 @@ void draw_right_triangle_clipped(int24_t x0, int24_t y0, uint8_t *tex, uint8_t *
 
             int24_t dy = (row - 1 + y0);
 
-            if(dy >= 0 && dy < LCD_HEIGHT && dx >= 0 && dx < LCD_WIDTH)
+            if(dy >= clip_y0 && dy < clip_y1 && dx >= 0 && dx < LCD_WIDTH) {
                 VRAM[LCD_WIDTH * dy + dx] = color;
+                COUNT_PX(1);
+            }
         }
     }
 
@@ -88,8 +157,10 @@ void draw_right_triangle_clipped(int24_t x0, int24_t y0, uint8_t *tex, uint8_t *
 
             int24_t dy = (8 + row - 1 + y0);
 
-            if(dy >= 0 && dy < LCD_HEIGHT && dx >= 0 && dx < LCD_WIDTH)
+            if(dy >= clip_y0 && dy < clip_y1 && dx >= 0 && dx < LCD_WIDTH) {
                 VRAM[LCD_WIDTH * dy + dx] = color;
+                COUNT_PX(1);
+            }
         }
     }
 }
@@ -97,11 +168,23 @@ void draw_right_triangle_clipped(int24_t x0, int24_t y0, uint8_t *tex, uint8_t *
 // Draws a left facing triangle
 void draw_left_triangle(int24_t x0, int24_t y0, uint8_t *tex, uint8_t *shadow_mask, uint8_t *water_mask) {
     // If we're going to clip, defer to the slow version
-    if(x0 < 16 || x0 > LCD_WIDTH || y0 < 0 || y0 >= LCD_HEIGHT - 16) {
+    if(x0 < 16 || x0 > LCD_WIDTH || y0 < clip_y0 || y0 >= clip_y1 - 16) {
         draw_left_triangle_clipped(x0, y0, tex, shadow_mask, water_mask);
         return;
     }
 
+    // Most triangles have no mask or a constant one, so only blend all three
+    // arrays when we have to
+    int24_t mask = constant_mask(shadow_mask, water_mask);
+    if(mask == 0) {
+        copy_left_triangle(x0, y0, tex);
+        return;
+    }
+    if(mask > 0) {
+        draw_left_triangle_const(x0, y0, tex, mask);
+        return;
+    }
+
     // Our base VRAM pointer for each line
     uint8_t* base = &VRAM[LCD_WIDTH * y0 + x0];
     // The width of each line as we draw
@@ -133,11 +216,23 @@ void draw_left_triangle(int24_t x0, int24_t y0, uint8_t *tex, uint8_t *shadow_ma
 // Draws a right facing triangle
 void draw_right_triangle(int24_t x0, int24_t y0, uint8_t *tex, uint8_t *shadow_mask, uint8_t *water_mask) {
     // If we're going to clip, defer to the slow version
-    if(x0 < 0 || x0 >= LCD_WIDTH - 16 || y0 < 0 || y0 >= LCD_HEIGHT - 16) {
+    if(x0 < 0 || x0 >= LCD_WIDTH - 16 || y0 < clip_y0 || y0 >= clip_y1 - 16) {
         draw_right_triangle_clipped(x0, y0, tex, shadow_mask, water_mask);
         return;
     }
 
+    // Most triangles have no mask or a constant one, so only blend all three
+    // arrays when we have to
+    int24_t mask = constant_mask(shadow_mask, water_mask);
+    if(mask == 0) {
+        copy_right_triangle(x0, y0, tex);
+        return;
+    }
+    if(mask > 0) {
+        draw_right_triangle_const(x0, y0, tex, mask);
+        return;
+    }
+
     // Our base VRAM pointer for each line
     uint8_t* base = &VRAM[LCD_WIDTH * y0 + x0];
     // The width of each line as we draw
@@ -173,8 +268,10 @@ void draw_left_triangle_clipped(int24_t x0, int24_t y0, uint8_t *water_mask) {
 
             int24_t dy = (row - 1 + y0);
 
-            if(dy >= 0 && dy < LCD_HEIGHT && dx >= 0 && dx < LCD_WIDTH)
+            if(dy >= clip_y0 && dy < clip_y1 && dx >= 0 && dx < LCD_WIDTH) {
                 VRAM[LCD_WIDTH * dy + dx] = color;
+                COUNT_PX(1);
+            }
         }
     }
 
@@ -184,8 +281,10 @@ void draw_left_triangle_clipped(int24_t x0, int24_t y0, uint8_t *water_mask) {
 
             int24_t dy = (8 + row - 1 + y0);
 
-            if(dy >= 0 && dy < LCD_HEIGHT && dx >= 0 && dx < LCD_WIDTH)
+            if(dy >= clip_y0 && dy < clip_y1 && dx >= 0 && dx < LCD_WIDTH) {
                 VRAM[LCD_WIDTH * dy + dx] = color;
+                COUNT_PX(1);
+            }
         }
     }
 }
@@ -198,8 +297,10 @@ void draw_right_triangle_clipped(int24_t x0, int24_t y0, uint8_t *water_mask) {
 
             int24_t dy = (row - 1 + y0);
 
-            if(dy >= 0 && dy < LCD_HEIGHT && dx >= 0 && dx < LCD_WIDTH)
+            if(dy >= clip_y0 && dy < clip_y1 && dx >= 0 && dx < LCD_WIDTH) {
                 VRAM[LCD_WIDTH * dy + dx] = color;
+                COUNT_PX(1);
+            }
         }
     }
 
@@ -209,8 +310,10 @@ void draw_right_triangle_clipped(int24_t x0, int24_t y0, uint8_t *water_mask) {
 
             int24_t dy = (8 + row - 1 + y0);
 
-            if(dy >= 0 && dy < LCD_HEIGHT && dx >= 0 && dx < LCD_WIDTH)
+            if(dy >= clip_y0 && dy < clip_y1 && dx >= 0 && dx < LCD_WIDTH) {
                 VRAM[LCD_WIDTH * dy + dx] = color;
+                COUNT_PX(1);
+            }
         }
     }
 }
@@ -218,7 +321,7 @@ void draw_right_triangle_clipped(int24_t x0, int24_t y0, uint8_t *water_mask) {
 // Draws a left facing triangle
 void draw_left_triangle(int24_t x0, int24_t y0, uint8_t *water_mask) {
     // If we're going to clip, defer to the slow version
-    if(x0 < 16 || x0 > LCD_WIDTH || y0 < 0 || y0 >= LCD_HEIGHT - 16) {
+    if(x0 < 16 || x0 > LCD_WIDTH || y0 < clip_y0 || y0 >= clip_y1 - 16) {
         draw_left_triangle_clipped(x0, y0, water_mask);
         return;
     }
@@ -248,7 +351,7 @@ void draw_left_triangle(int24_t x0, int24_t y0, uint8_t *water_mask) {
 // Draws a right facing triangle
 void draw_right_triangle(int24_t x0, int24_t y0, uint8_t *water_mask) {
     // If we're going to clip, defer to the slow version
-    if(x0 < 0 || x0 >= LCD_WIDTH - 16 || y0 < 0 || y0 >= LCD_HEIGHT - 16) {
+    if(x0 < 0 || x0 >= LCD_WIDTH - 16 || y0 < clip_y0 || y0 >= clip_y1 - 16) {
         draw_right_triangle_clipped(x0, y0, water_mask);
         return;
     }
@@ -288,8 +391,10 @@ void draw_left_triangle_clipped(int24_t x0, int24_t y0, uint8_t *tex, uint8_t fl
 
             int24_t dy = (row - 1 + y0);
 
-            if(dy >= 0 && dy < LCD_HEIGHT && dx >= 0 && dx < LCD_WIDTH)
+            if(dy >= clip_y0 && dy < clip_y1 && dx >= 0 && dx < LCD_WIDTH) {
                 VRAM[LCD_WIDTH * dy + dx] = color;
+                COUNT_PX(1);
+            }
         }
     }
 
@@ -303,8 +408,10 @@ void draw_left_triangle_clipped(int24_t x0, int24_t y0, uint8_t *tex, uint8_t fl
 
             int24_t dy = (8 + row - 1 + y0);
 
-            if(dy >= 0 && dy < LCD_HEIGHT && dx >= 0 && dx < LCD_WIDTH)
+            if(dy >= clip_y0 && dy < clip_y1 && dx >= 0 && dx < LCD_WIDTH) {
                 VRAM[LCD_WIDTH * dy + dx] = color;
+                COUNT_PX(1);
+            }
         }
     }
 }
@@ -321,8 +428,10 @@ void draw_right_triangle_clipped(int24_t x0, int24_t y0, uint8_t *tex, uint8_t f
 
             int24_t dy = (row - 1 + y0);
 
-            if(dy >= 0 && dy < LCD_HEIGHT && dx >= 0 && dx < LCD_WIDTH)
+            if(dy >= clip_y0 && dy < clip_y1 && dx >= 0 && dx < LCD_WIDTH) {
                 VRAM[LCD_WIDTH * dy + dx] = color;
+                COUNT_PX(1);
+            }
         }
     }
 
@@ -336,8 +445,10 @@ void draw_right_triangle_clipped(int24_t x0, int24_t y0, uint8_t *tex, uint8_t f
 
             int24_t dy = (8 + row - 1 + y0);
 
-            if(dy >= 0 && dy < LCD_HEIGHT && dx >= 0 && dx < LCD_WIDTH)
+            if(dy >= clip_y0 && dy < clip_y1 && dx >= 0 && dx < LCD_WIDTH) {
                 VRAM[LCD_WIDTH * dy + dx] = color;
+                COUNT_PX(1);
+            }
         }
     }
 }
@@ -345,7 +456,7 @@ void draw_right_triangle_clipped(int24_t x0, int24_t y0, uint8_t *tex, uint8_t f
 // Draws a left facing triangle
 void draw_left_triangle(int24_t x0, int24_t y0, uint8_t *tex, uint8_t flags) {
     // If we're going to clip, defer to the slow version
-    if(x0 < 16 || x0 > LCD_WIDTH || y0 < 0 || y0 >= LCD_HEIGHT - 16) {
+    if(x0 < 16 || x0 > LCD_WIDTH || y0 < clip_y0 || y0 >= clip_y1 - 16) {
         draw_left_triangle_clipped(x0, y0, tex, flags);
         return;
     }
@@ -377,7 +488,7 @@ void draw_left_triangle(int24_t x0, int24_t y0, uint8_t *tex, uint8_t flags) {
 // Draws a right facing triangle
 void draw_right_triangle(int24_t x0, int24_t y0, uint8_t *tex, uint8_t flags) {
     // If we're going to clip, defer to the slow version
-    if(x0 < 0 || x0 >= LCD_WIDTH - 16 || y0 < 0 || y0 >= LCD_HEIGHT - 16) {
+    if(x0 < 0 || x0 >= LCD_WIDTH - 16 || y0 < clip_y0 || y0 >= clip_y1 - 16) {
         draw_right_triangle_clipped(x0, y0, tex, flags);
         return;
     }
@@ -406,6 +517,202 @@ void draw_right_triangle(int24_t x0, int24_t y0, uint8_t *tex, uint8_t flags) {
 
 
 
+// Draws a left facing triangle with the same mask byte ORed into every pixel
+void draw_left_triangle_const(int24_t x0, int24_t y0, uint8_t *tex, uint8_t mask) {
+    // If we're going to clip, defer to the slow version
+    if(x0 < 16 || x0 > LCD_WIDTH || y0 < clip_y0 || y0 >= clip_y1 - 16) {
+        draw_left_triangle_clipped(x0, y0, tex, mask & SHADOW ? full_shadow : empty, mask & UNDERWATER ? full_water : empty);
+        return;
+    }
+
+    // Our base VRAM pointer for each line
+    uint8_t* base = &VRAM[LCD_WIDTH * y0 + x0];
+    // The width of each line as we draw
+    uint8_t width = 0;
+
+    // Top half
+    for(int row = 1; row <= 8; row++) {
+        width += 2;
+        copy_tex_line_const(base - width, tex, mask, width);
+        tex += width;
+        base += LCD_WIDTH;
+    }
+
+    // Bottom half
+    for(int row = 1; row < 8; row++) {
+        width -= 2;
+        copy_tex_line_const(base - width, tex, mask, width);
+        tex += width;
+        base += LCD_WIDTH;
+    }
+}
+
+// Draws a right facing triangle with the same mask byte ORed into every pixel
+void draw_right_triangle_const(int24_t x0, int24_t y0, uint8_t *tex, uint8_t mask) {
+    // If we're going to clip, defer to the slow version
+    if(x0 < 0 || x0 >= LCD_WIDTH - 16 || y0 < clip_y0 || y0 >= clip_y1 - 16) {
+        draw_right_triangle_clipped(x0, y0, tex, mask & SHADOW ? full_shadow : empty, mask & UNDERWATER ? full_water : empty);
+        return;
+    }
+
+    // Our base VRAM pointer for each line
+    uint8_t* base = &VRAM[LCD_WIDTH * y0 + x0];
+    // The width of each line as we draw
+    uint8_t width = 0;
+
+    // Top half
+    for(int row = 1; row <= 8; row++) {
+        width += 2;
+        copy_tex_line_const(base, tex, mask, width);
+        tex += width;
+        base += LCD_WIDTH;
+    }
+
+    // Bottom half
+    for(int row = 1; row < 8; row++) {
+        width -= 2;
+        copy_tex_line_const(base, tex, mask, width);
+        tex += width;
+        base += LCD_WIDTH;
+    }
+}
+
+
+// Copies a precomposited left facing triangle straight into VRAM
+void copy_left_triangle(int24_t x0, int24_t y0, uint8_t *tri) {
+    // If we're going to clip, defer to the slow version
+    if(x0 < 16 || x0 > LCD_WIDTH || y0 < clip_y0 || y0 >= clip_y1 - 16) {
+        draw_left_triangle_clipped(x0, y0, tri, empty, empty);
+        return;
+    }
+
+    // Our base VRAM pointer for each line
+    uint8_t* base = &VRAM[LCD_WIDTH * y0 + x0];
+    // The width of each line as we draw
+    uint8_t width = 0;
+
+    // Top half
+    for(int row = 1; row <= 8; row++) {
+        width += 2;
+        copy_tri_line(base - width, tri, width);
+        tri += width;
+        base += LCD_WIDTH;
+    }
+
+    // Bottom half
+    for(int row = 1; row < 8; row++) {
+        width -= 2;
+        copy_tri_line(base - width, tri, width);
+        tri += width;
+        base += LCD_WIDTH;
+    }
+}
+
+// Copies a precomposited right facing triangle straight into VRAM
+void copy_right_triangle(int24_t x0, int24_t y0, uint8_t *tri) {
+    // If we're going to clip, defer to the slow version
+    if(x0 < 0 || x0 >= LCD_WIDTH - 16 || y0 < clip_y0 || y0 >= clip_y1 - 16) {
+        draw_right_triangle_clipped(x0, y0, tri, empty, empty);
+        return;
+    }
+
+    // Our base VRAM pointer for each line
+    uint8_t* base = &VRAM[LCD_WIDTH * y0 + x0];
+    // The width of each line as we draw
+    uint8_t width = 0;
+
+    // Top half
+    for(int row = 1; row <= 8; row++) {
+        width += 2;
+        copy_tri_line(base, tri, width);
+        tri += width;
+        base += LCD_WIDTH;
+    }
+
+    // Bottom half
+    for(int row = 1; row < 8; row++) {
+        width -= 2;
+        copy_tri_line(base, tri, width);
+        tri += width;
+        base += LCD_WIDTH;
+    }
+}
+
+
+// Empties the cache. Must be called before the first draw_tri_grid of a session
+void clear_tri_cache() {
+    memset(tri_cache->slot_of, 0, sizeof(tri_cache->slot_of));
+    memset(tri_cache->key_of, 0, sizeof(tri_cache->key_of));
+    memset(tri_cache->used, 0, sizeof(tri_cache->used));
+    tri_cache->next = 0;
+    tri_cache_hits = 0;
+    tri_cache_misses = 0;
+}
+
+// Returns the composited triangle for a texture (0 for sky), face half and
+// shadow/water states, compositing it into the cache on a miss
+uint8_t *cached_triangle(uint8_t texture, uint8_t half, uint8_t shadow, uint8_t water) {
+    uint16_t key = ((texture * 6 + half) * 4 + shadow) * 3 + water;
+    uint8_t slot = tri_cache->slot_of[key];
+
+    if(slot != 0) {
+        tri_cache_hits++;
+        tri_cache->used[slot - 1] = 1;
+        return tri_cache->tris[slot - 1];
+    }
+    tri_cache_misses++;
+
+    // Find a slot that hasn't been used since the sweep last passed it
+    while(true) {
+        slot = tri_cache->next;
+        if(++tri_cache->next == TRI_CACHE_SLOTS)
+            tri_cache->next = 0;
+        if(!tri_cache->used[slot]) break;
+        tri_cache->used[slot] = 0;
+    }
+
+    uint8_t *old_key_slot = &tri_cache->slot_of[tri_cache->key_of[slot]];
+    if(*old_key_slot == slot + 1)
+        *old_key_slot = 0;
+
+    // New entries start out used so the next miss can't evict them
+    // before the caller is done with them
+    tri_cache->key_of[slot] = key;
+    tri_cache->slot_of[key] = slot + 1;
+    tri_cache->used[slot] = 1;
+
+    uint8_t *tri = tri_cache->tris[slot];
+    uint8_t *shadow_mask = shadow_masks[shadow][half];
+    uint8_t *water_mask = water_masks[water][half];
+    int24_t mask = constant_mask(shadow_mask, water_mask);
+
+    if(texture == 0) {
+        if(mask >= 0) {
+            memset(tri, SKY | mask, TEX_SIZE);
+        }
+        else {
+            for(int i = 0; i < TEX_SIZE; i++)
+                tri[i] = SKY | water_mask[i];
+        }
+    }
+    else {
+        uint8_t *tex = textures[texture - 1][half];
+        if(mask == 0) {
+            memcpy(tri, tex, TEX_SIZE);
+        }
+        else if(mask > 0) {
+            for(int i = 0; i < TEX_SIZE; i++)
+                tri[i] = tex[i] | mask;
+        }
+        else {
+            for(int i = 0; i < TEX_SIZE; i++)
+                tri[i] = tex[i] | shadow_mask[i] | water_mask[i];
+        }
+    }
+
+    return tri;
+}
+
 
 void draw_block(int24_t x, int24_t y, uint8_t *tex) {
 
@@ -426,7 +733,88 @@ void draw_block(uint8_t x, uint8_t y, uint8_t z, uint8_t *tex) {
     draw_block(screen_x, screen_y, tex);
 }
 
+// Returns the cached composite of a triangle in the grid. side is 0 for
+// left facing triangles and 1 for right facing ones
+uint8_t *grid_triangle(world_t &world, int tri_grid_idx, uint8_t side) {
+    uint8_t texture = world.cell_tex(tri_grid_idx);
+    //uint8_t texture = world.cell_depth(tri_grid_idx) % 8 + STONE;
+    uint8_t flags = world.cell_flags(tri_grid_idx);
+
+    uint8_t face = flags & FACE_MASK;
+    uint8_t shadow = (flags & SHADOW_MASK) >> SHADOW_OFFSET;
+    uint8_t water  = (flags & WATER_MASK)  >> WATER_OFFSET;
+
+    // Map block IDs onto cache texture slots, with the sky at zero.
+    // Empty triangles have no shadow, only water
+    if(texture != 0)
+        texture -= 1;
+    else
+        shadow = 0;
+
+    return cached_triangle(texture, face * 2 + side, shadow, water);
+}
+
+// Draws a single triangle of the grid with its top corner at (x, y) on screen
+void draw_tri(world_t &world, int tri_grid_idx, bool left, int24_t x, int24_t y) {
+    if(left)
+        copy_left_triangle(x, y, grid_triangle(world, tri_grid_idx, 0));
+    else
+        copy_right_triangle(x, y, grid_triangle(world, tri_grid_idx, 1));
+}
+
+#ifdef TRI_RUNS
+// Fills the diamond covered by a left and right triangle pair with one color
+void fill_tri_pair(int24_t x0, int24_t y0, uint8_t color) {
+    // Our base VRAM pointer for each line
+    uint8_t* base = &VRAM[LCD_WIDTH * y0 + x0];
+    // The width of each half of the line as we draw
+    uint8_t width = 0;
+
+    // Top half
+    for(int row = 1; row <= 8; row++) {
+        width += 2;
+        memset(base - width, color, 2 * width);
+        COUNT_PX(2 * width);
+        base += LCD_WIDTH;
+    }
+
+    // Bottom half
+    for(int row = 1; row < 8; row++) {
+        width -= 2;
+        memset(base - width, color, 2 * width);
+        COUNT_PX(2 * width);
+        base += LCD_WIDTH;
+    }
+}
+
+// Draws a run of identical triangle pairs, starting with the left triangle at
+// tri_grid_idx whose top corner is at (x, y) on screen
+void draw_tri_run(world_t &world, int tri_grid_idx, int pairs, int24_t x, int24_t y) {
+    uint8_t *left_tri = grid_triangle(world, tri_grid_idx, 0);
+    uint8_t *right_tri = grid_triangle(world, tri_grid_idx + 1, 1);
+
+    // Empty sky that is clear or entirely underwater is a single color, so the
+    // whole pair can be filled a line at a time
+    uint8_t water = world.cell_flags(tri_grid_idx) & WATER_MASK;
+    bool solid = world.cell_tex(tri_grid_idx) == AIR && world.cell_tex(tri_grid_idx + 1) == AIR &&
+                 water == (world.cell_flags(tri_grid_idx + 1) & WATER_MASK) && water != WATER_HALF;
+    uint8_t color = SKY | (water == WATER_FULL ? UNDERWATER : 0);
+
+    for(; pairs > 0; pairs--, x += 32) {
+        if(solid && x >= 16 && x < LCD_WIDTH - 16 && y >= clip_y0 && y < clip_y1 - 16) {
+            fill_tri_pair(x, y, color);
+        }
+        else {
+            copy_left_triangle(x, y, left_tri);
+            copy_right_triangle(x, y, right_tri);
+        }
+    }
+}
+#endif
+
 void draw_tri_grid(world_t &world) {
+    PERF_SCOPE(PERF_TRI_GRID);
+
     uint24_t origin_x = LCD_WIDTH / 2;
     uint24_t draw_y = LCD_HEIGHT - 15;
 
@@ -440,9 +828,9 @@ void draw_tri_grid(world_t &world) {
     draw_y -= 8 * start_row;
 
     for(int row = start_row; row < end_row; row++) {
-        int width = world.tri_grid_row_width[row];
-        int24_t draw_x = origin_x - world.tri_grid_row_px_offset[row];
-        int offset = world.tri_grid_row_offset[row];
+        int width = tri_geometry.row_width[row];
+        int24_t draw_x = origin_x - tri_geometry.row_px_offset[row];
+        int offset = tri_geometry.row_offset[row];
         
         // Round down the start triangle, and up the end triangle
         int start_tri = (draw_x0 - draw_x - scroll_x + 16) / 16;
@@ -459,46 +847,28 @@ void draw_tri_grid(world_t &world) {
         }
         
         for(int i = start_tri; i < end_tri; i++) {
-            uint8_t texture = world.tri_grid_tex[world.tri_grid_rows[row] + i];
-            //uint8_t texture = world.tri_grid_depth[world.tri_grid_rows[row] + i] % 8 + STONE;
-            uint8_t flags = world.tri_grid_flags[world.tri_grid_rows[row] + i];
-
-            uint8_t face = flags & FACE_MASK;
-            uint8_t shadow = (flags & SHADOW_MASK) >> SHADOW_OFFSET;
-            uint8_t water  = (flags & WATER_MASK)  >> WATER_OFFSET;
+            int tri_grid_idx = tri_geometry.rows[row] + i;
 
             if(((i - offset) & 1) == 0) {
-                // Draw filled triangles with texture and shadows
-                if(texture != 0) {
-                    texture -= 2;
-                    draw_left_triangle(draw_x + scroll_x, draw_y + scroll_y, 
-                                       textures[texture][face * 2 + 0], 
-                                       shadow_masks[shadow][face * 2 + 0],
-                                       water_masks[water][face * 2 + 0]);
+#ifdef TRI_RUNS
+                // Count how many of the following pairs match this one
+                int pairs = 1;
+                while(i + 2 * pairs + 1 < end_tri &&
+                      world.tri_run(tri_grid_idx + 2 * pairs - 2) &&
+                      world.tri_run(tri_grid_idx + 2 * pairs - 1))
+                    pairs++;
+
+                if(pairs > 1) {
+                    draw_tri_run(world, tri_grid_idx, pairs, draw_x + scroll_x, draw_y + scroll_y);
+                    i += 2 * pairs - 1;
+                    draw_x += 32 * pairs;
+                    continue;
                 }
-                // Draw empty triangles with sky color and water
-                else 
-                {
-                    draw_left_triangle(draw_x + scroll_x, draw_y + scroll_y, 
-                                       water_masks[water][face * 2 + 0]);
-                }
-
+#endif
+                draw_tri(world, tri_grid_idx, true, draw_x + scroll_x, draw_y + scroll_y);
             }
             else {
-                // Draw filled triangles with texture and shadows
-                if(texture != 0) {
-                    texture -= 2;
-                    draw_right_triangle(draw_x + scroll_x, draw_y + scroll_y, 
-                                        textures[texture][face * 2 + 1], 
-                                        shadow_masks[shadow][face * 2 + 1],
-                                        water_masks[water][face * 2 + 1]);
-                }
-                // Draw empty triangles with sky color and water
-                else 
-                {
-                    draw_right_triangle(draw_x + scroll_x, draw_y + scroll_y, 
-                                        water_masks[water][face * 2 + 1]);
-                }
+                draw_tri(world, tri_grid_idx, false, draw_x + scroll_x, draw_y + scroll_y);
 
                 draw_x += 32;
             }
@@ -508,108 +878,234 @@ void draw_tri_grid(world_t &world) {
     }
 }
 
-void scroll_view(world_t &world, int24_t x, int24_t y) {
-    // Swap our draw buffer
-    uint8_t* old_VRAM = VRAM;
-    VRAM = (uint8_t*)((uint24_t)VRAM ^ BUFFER_SWP);
+void draw_dirty_tris(world_t &world) {
+    int24_t draw_y = LCD_HEIGHT - 15 + scroll_y;
 
-    scroll_x += x;
-    scroll_y += y;
+    for(int row = 0; row < ROW_CNT; row++, draw_y -= 8) {
+        // Skip rows that are entirely off screen
+        if(draw_y >= LCD_HEIGHT || draw_y + 15 <= 0) continue;
 
-    int24_t abs_x = (x > 0) ? x : -x;
-    int24_t abs_y = (y > 0) ? y : -y;
+        int start = tri_geometry.rows[row];
+        int end = start + tri_geometry.row_width[row];
+        int offset = tri_geometry.row_offset[row];
+        int24_t row_x = LCD_WIDTH / 2 - tri_geometry.row_px_offset[row] - 16 * (offset & 1) + scroll_x;
 
-    uint8_t *src_row = old_VRAM;
-    uint8_t *dst_row = VRAM;
+        for(int idx = start; idx < end; idx++) {
+            // Step over whole bytes of clean triangles at a time
+            if(world.tri_grid_dirty[idx >> 3] == 0) {
+                idx |= 7;
+                continue;
+            }
+            if(!(world.tri_grid_dirty[idx >> 3] & (1 << (idx & 7)))) continue;
 
-    // Vertical scrolling
-    if(y > 0) {
-        dst_row += LCD_WIDTH * abs_y;
-    }
-    else {
-        src_row += LCD_WIDTH * abs_y;
+            // Left triangles extend left of their x and right triangles extend
+            // right of it, so both triangles in a pair share the same x
+            int i = idx - start;
+            int24_t draw_x = row_x + 32 * ((i + (offset & 1)) >> 1);
+            if(draw_x + 16 <= 0 || draw_x - 16 >= LCD_WIDTH) continue;
+
+            draw_tri(world, idx, ((i - offset) & 1) == 0, draw_x, draw_y);
+        }
     }
-    
-    // Horizontal scrolling
-    if(x > 0) {
-        dst_row += abs_x;
+
+    world.clear_dirty();
+}
+
+// Copies rows row0 to row1 of the frame at src into the frame at dst, shifted
+// by (x, y). The rows written mustn't overlap the rows read
+void shift_frame(uint8_t *dst, uint8_t *src, int24_t x, int24_t y, int24_t row0, int24_t row1) {
+    int24_t abs_x = (x > 0) ? x : -x;
+
+    // Only the rows that were already in view have anything to copy
+    if(row0 < y) {
+        row0 = y;
     }
-    else {
-        src_row += abs_x;
+    if(row1 > LCD_HEIGHT + y) {
+        row1 = LCD_HEIGHT + y;
     }
 
-    // Copy over the old frame onto the new one
-    for(int row = 0; row < LCD_HEIGHT - abs_y; row++) {
-        memcpy((void*)dst_row, (void*)src_row, LCD_WIDTH - abs_x);
+    for(int24_t row = row0; row < row1; row++) {
+        uint8_t *dst_row = dst + LCD_WIDTH * row;
+        uint8_t *src_row = src + LCD_WIDTH * (row - y);
+
+        if(x > 0) {
+            dst_row += abs_x;
+        }
+        else {
+            src_row += abs_x;
+        }
 
-        src_row += LCD_WIDTH;
-        dst_row += LCD_WIDTH;
+        memcpy((void*)dst_row, (void*)src_row, LCD_WIDTH - abs_x);
+        COUNT_PX(LCD_WIDTH - abs_x);
     }
+}
 
+void show_frame() {
+    *lcd_icr = LCD_INT_LNBU;
+    *lcd_base = (uint24_t)VRAM;
+}
 
-    // Vertical scrolling
-    draw_x0 = 0;
-    draw_x1 = LCD_WIDTH;
-    
-    if(y > 0) {
-        draw_y0 = 0;
-        draw_y1 = y + 16;
-    }
-    else if(y < 0) {        
-        draw_y0 = LCD_HEIGHT + y - 16;
-        draw_y1 = LCD_HEIGHT;
-    }
+void wait_frame() {
+    while(!(*lcd_ris & LCD_INT_LNBU));
+}
+
+// Clears and redraws the strips that a scroll by (x, y) brings into view,
+// within rows row0 to row1 of the frame at VRAM. Nothing outside those rows
+// is written, since the triangles are clipped to them
+static void draw_strips(world_t &world, int24_t x, int24_t y, int24_t row0, int24_t row1) {
+    PERF_SCOPE(PERF_SCROLL_STRIPS);
 
+    clip_y0 = row0;
+    clip_y1 = row1;
+
+    // Vertical scrolling
     if(y != 0) {
-        // Clear out the rectangle
-        for(int y = draw_y0; y < draw_y1; y++) {
-            memset(&VRAM[y * LCD_WIDTH + draw_x0], SKY, draw_x1 - draw_x0);
+        // Clear out the newly exposed rows, then redraw in a patch that
+        // reaches far enough in to finish the triangles cut off at the edge
+        int24_t clear_y0 = (y > 0) ? 0 : LCD_HEIGHT + y;
+        int24_t clear_y1 = (y > 0) ? y : LCD_HEIGHT;
+        if(clear_y0 < row0) {
+            clear_y0 = row0;
+        }
+        if(clear_y1 > row1) {
+            clear_y1 = row1;
+        }
+        if(clear_y0 < clear_y1) {
+            memset(&VRAM[clear_y0 * LCD_WIDTH], SKY, (clear_y1 - clear_y0) * LCD_WIDTH);
+            COUNT_PX((clear_y1 - clear_y0) * LCD_WIDTH);
         }
 
-        // Redraw in a patch
-        draw_tri_grid(world);
-    }
-
-    
-    // Horizontal scrolling
-    draw_y0 = 0;
-    draw_y1 = LCD_HEIGHT;
-    
-    if(x > 0) {
         draw_x0 = 0;
-        draw_x1 = x + 16;
-    }
-    else if(x < 0) {
-        draw_x0 = LCD_WIDTH + x - 16;
         draw_x1 = LCD_WIDTH;
+        int24_t patch_y0 = (y > 0) ? 0 : LCD_HEIGHT + y - 16;
+        int24_t patch_y1 = (y > 0) ? y + 16 : LCD_HEIGHT;
+        draw_y0 = (patch_y0 > row0) ? patch_y0 : row0;
+        draw_y1 = (patch_y1 < row1) ? patch_y1 : row1;
+        if(draw_y0 < draw_y1) {
+            draw_tri_grid(world);
+        }
     }
 
+    // Horizontal scrolling
     if(x != 0) {
-        // Clear out the rectangle
-        for(int y = draw_y0; y < draw_y1; y++) {
-            memset(&VRAM[y * LCD_WIDTH + draw_x0], SKY, draw_x1 - draw_x0);
+        // Clear out the newly exposed columns
+        int24_t clear_x0 = (x > 0) ? 0 : LCD_WIDTH + x;
+        int24_t clear_x1 = (x > 0) ? x : LCD_WIDTH;
+        for(int24_t row = row0; row < row1; row++) {
+            memset(&VRAM[row * LCD_WIDTH + clear_x0], SKY, clear_x1 - clear_x0);
+            COUNT_PX(clear_x1 - clear_x0);
+        }
+
+        draw_x0 = (x > 0) ? 0 : LCD_WIDTH + x - 16;
+        draw_x1 = (x > 0) ? x + 16 : LCD_WIDTH;
+        draw_y0 = row0;
+        draw_y1 = row1;
+        if(draw_y0 < draw_y1) {
+            draw_tri_grid(world);
+        }
+    }
+
+    clip_y0 = 0;
+    clip_y1 = LCD_HEIGHT;
+}
+
+// Moves the frame on screen to the far end of VRAM from where it sits, shifted
+// by (x, y), and draws whatever that brings into view, then shows it. Nothing
+// on screen is touched before the LCD has moved off it
+static void move_frame(world_t *world, int24_t x, int24_t y) {
+    PERF_SCOPE(PERF_SCROLL_COPY);
+
+    // The frame on screen starts this many rows into VRAM
+    uint8_t *old_VRAM = VRAM;
+    int24_t split = (old_VRAM - (uint8_t*)BUFFER_1) / LCD_WIDTH;
+
+    // From BUFFER_1 there's a whole frame free after it
+    if(split == 0) {
+        VRAM = (uint8_t*)BUFFER_2;
+        shift_frame(VRAM, old_VRAM, x, y, 0, LCD_HEIGHT);
+        if(world) {
+            draw_strips(*world, x, y, 0, LCD_HEIGHT);
         }
+        show_frame();
+        return;
+    }
+
+    // Otherwise the new frame goes at BUFFER_1. Its first rows are free
+    // already. The rest would overwrite the frame on screen, so they're built
+    // in the free space past it for now
+    VRAM = (uint8_t*)BUFFER_1;
+    shift_frame(VRAM, old_VRAM, x, y, 0, split);
+    if(world) {
+        draw_strips(*world, x, y, 0, split);
+    }
+
+    VRAM = (uint8_t*)BUFFER_2;
+    shift_frame(VRAM, old_VRAM, x, y, split, LCD_HEIGHT);
+    if(world) {
+        draw_strips(*world, x, y, split, LCD_HEIGHT);
+    }
+
+    // Once the LCD has picked up the new address, the old frame is free to
+    // overwrite. The LCD reads those rows last, and a plain copy outruns it
+    VRAM = (uint8_t*)BUFFER_1;
+    show_frame();
+    wait_frame();
+
+    memcpy(&VRAM[split * LCD_WIDTH], (uint8_t*)BUFFER_2 + split * LCD_WIDTH, (LCD_HEIGHT - split) * LCD_WIDTH);
+    COUNT_PX((LCD_HEIGHT - split) * LCD_WIDTH);
+}
+
+void scroll_view(world_t &world, int24_t x, int24_t y) {
+    // The patch drawn below overlaps the frame currently on screen, so let the
+    // LCD finish switching to it first
+    wait_frame();
+
+    scroll_x += x;
+    scroll_y += y;
 
-        // Redraw in a patch
-        draw_tri_grid(world);
+    // VRAM has room for two frames, and the view pans vertically through it
+    // by moving the address the LCD starts reading from. The rows that come
+    // into view are off screen until the switch, and the rest of the patch
+    // already holds the right pixels, so it's only drawn over
+    uint8_t *panned = VRAM - LCD_WIDTH * y;
+
+    // Panning horizontally would wrap the pixels pushed off one side of a row
+    // onto the next, which is on screen. Those steps, and ones that run off
+    // either end of VRAM, move the frame instead
+    if(x != 0 || panned < (uint8_t*)BUFFER_1 || panned > (uint8_t*)BUFFER_2) {
+        move_frame(&world, x, y);
+        return;
     }
 
-    gfx_SwapDraw();
+    VRAM = panned;
+    draw_strips(world, 0, y, 0, LCD_HEIGHT);
+    show_frame();
+}
+
+void reset_view() {
+    wait_frame();
+    if(VRAM != (uint8_t*)BUFFER_1) {
+        move_frame(nullptr, 0, 0);
+    }
+    gfx_SetDrawBuffer();
 }
 
 void dim_screen() {
-    // Swap our draw buffer
+    // The dimmed copy goes in whichever buffer the frame isn't in, which is
+    // only a whole buffer away once the frame is back at BUFFER_1
+    reset_view();
+
     uint8_t* old_VRAM = VRAM;
-    VRAM = (uint8_t*)((uint24_t)VRAM ^ BUFFER_SWP);
+    VRAM = (uint8_t*)BUFFER_2;
 
     memcpy(VRAM, old_VRAM, LCD_CNT);
+    COUNT_PX(LCD_CNT);
 
     for(int i = 0; i < LCD_CNT; i++) {
         VRAM[i] |= SHADOW;
     }
 }
 
-
 void draw_num(int24_t x, int24_t y, uint8_t n) {
     char buf[4];
 
@@ -4,6 +4,7 @@
 #include <string.h>
 #include "textures.h"
 #include "world.h"
+#include "arena.h"
 
 #define BLOCK_WIDTH  32
 #define BLOCK_HALF_WIDTH  (BLOCK_WIDTH / 2)
@@ -13,15 +14,64 @@
 
 #define LCD_CNT (LCD_WIDTH * LCD_HEIGHT)
 
-#define BUFFER_1 0xD40000
-#define BUFFER_2 0xD52C00
 #define BUFFER_SWP (BUFFER_1 ^ BUFFER_2)
 
 extern uint8_t* VRAM;
 
+extern volatile uint24_t* lcd_base;
+extern volatile uint8_t* lcd_ris;
+extern volatile uint8_t* lcd_icr;
+
+// Set in lcd_ris once the LCD has picked up a new lcd_base, at the start of a refresh
+#define LCD_INT_LNBU 4
+
 extern int24_t scroll_x;
 extern int24_t scroll_y;
 
+#ifdef BENCH
+// Running count of pixels written to VRAM, read by the host benchmark
+extern uint24_t bench_px_written;
+#define COUNT_PX(n) (bench_px_written += (n))
+#else
+#define COUNT_PX(n)
+#endif
+
+#ifdef PERF_HUD
+#include <sys/timers.h>
+
+// Subsystems timed for the performance HUD. Times are inclusive, so a
+// subsystem that calls another (place_block calling scan_tri, player.undraw
+// calling draw_tri_grid) also counts the time spent in it
+enum perf_counter {
+    PERF_TRI_GRID,
+    PERF_SCROLL_COPY,
+    PERF_SCROLL_STRIPS,
+    PERF_PLAYER,
+    PERF_PLACE_BLOCK,
+    PERF_REMOVE_BLOCK,
+    PERF_SHADOWS,
+    PERF_SCAN_TRI,
+    PERF_CNT
+};
+
+// CPU cycles spent in each subsystem this frame, counted with hardware timer 2
+extern uint32_t perf_cycles[PERF_CNT];
+
+// Adds the cycles from its construction until the end of the enclosing scope
+// to a counter, however the scope is left
+struct perf_scope {
+    uint8_t counter;
+    uint32_t start;
+
+    perf_scope(uint8_t counter) : counter(counter), start(timer_Get(2)) {}
+    ~perf_scope() { perf_cycles[counter] += timer_Get(2) - start; }
+};
+
+#define PERF_SCOPE(counter) perf_scope perf_scope_(counter)
+#else
+#define PERF_SCOPE(counter)
+#endif
+
 // Bounds to draw within
 extern uint16_t draw_x0;
 extern uint16_t draw_y0;
@@ -61,14 +111,95 @@ void draw_left_triangle(int24_t x0, int24_t y0, uint8_t *tex, uint8_t flags);
 void draw_right_triangle(int24_t x0, int24_t y0, uint8_t *tex, uint8_t flags);
 
 
+// Draws a left facing triangle with the same mask byte ORed into every pixel
+void draw_left_triangle_const(int24_t x0, int24_t y0, uint8_t *tex, uint8_t mask);
+
+// Draws a right facing triangle with the same mask byte ORed into every pixel
+void draw_right_triangle_const(int24_t x0, int24_t y0, uint8_t *tex, uint8_t mask);
+
+
+// Copies a precomposited left facing triangle straight into VRAM
+void copy_left_triangle(int24_t x0, int24_t y0, uint8_t *tri);
+
+// Copies a precomposited right facing triangle straight into VRAM
+void copy_right_triangle(int24_t x0, int24_t y0, uint8_t *tri);
+
+
+// -------- Triangle Cache --------
+// Triangles with their shadow and water masks already applied, keyed by
+// (texture, face half, shadow state, water state). Most of the screen is a
+// handful of these combinations, so draw_tri_grid can blit them with a plain
+// copy instead of blending three arrays per pixel.
+//
+// The cache lives in whatever Safe RAM is left over after world_t, up to
+// SAFE_RAM_END, so it shrinks automatically as the world grows.
+
+// The world takes the start of the arena, after the program's variables, and
+// the cache gets the rest
+constexpr ram_block_t WORLD_RAM = arena_first(SAFE_RAM_ARENA, sizeof(world_t));
+static_assert(block_within(WORLD_RAM, SAFE_RAM_ARENA), "world_t must fit in Safe RAM");
+constexpr ram_block_t TRI_CACHE_BUDGET = arena_rest(SAFE_RAM_ARENA, WORLD_RAM, alignof(uint16_t));
+static_assert(block_end(TRI_CACHE_BUDGET) == SAFE_RAM_END, "The cache is sized from the end of Safe RAM");
+
+// Texture slot 0 is the sky, the rest are textures[] shifted up by one
+#define TRI_CACHE_KEYS ((TEX_CNT + 1) * 6 * 4 * 3)
+#define TRI_CACHE_SLOTS ((TRI_CACHE_BUDGET.size - TRI_CACHE_KEYS - 2) / (TEX_SIZE + 3))
+static_assert(TRI_CACHE_SLOTS >= 8 && TRI_CACHE_SLOTS < 255, "Triangle cache must fit at least 8 slots and be indexable by a byte");
+
+typedef struct tri_cache {
+    // The slot (plus one) holding each key, or zero if it isn't cached
+    uint8_t slot_of[TRI_CACHE_KEYS];
+    // The key held by each slot, so it can be unlinked on eviction
+    uint16_t key_of[TRI_CACHE_SLOTS];
+    // Set on every hit. Eviction sweeps round robin, giving slots that were
+    // used since the last sweep a second chance
+    uint8_t used[TRI_CACHE_SLOTS];
+    uint16_t next;
+    uint8_t tris[TRI_CACHE_SLOTS][TEX_SIZE];
+} tri_cache_t;
+
+constexpr ram_block_t TRI_CACHE_RAM = arena_next(WORLD_RAM, sizeof(tri_cache_t), alignof(tri_cache_t));
+static_assert(block_within(TRI_CACHE_RAM, SAFE_RAM_ARENA), "The triangle cache must fit in what's left of Safe RAM");
+
+extern tri_cache_t *tri_cache;
+
+extern uint24_t tri_cache_hits;
+extern uint24_t tri_cache_misses;
+
+// Empties the cache. Must be called before the first draw_tri_grid of a session
+void clear_tri_cache();
+
+// Returns the composited triangle for a texture (0 for sky), face half and
+// shadow/water states, compositing it into the cache on a miss
+uint8_t *cached_triangle(uint8_t texture, uint8_t half, uint8_t shadow, uint8_t water);
+
+
 void draw_block(int24_t x, int24_t y, uint8_t *tex);
 
 void draw_block(uint8_t x, uint8_t y, uint8_t z, uint8_t *tex);
 
 void draw_tri_grid(world_t &world);
 
+// Repaints only the triangles marked in world.tri_grid_dirty, then clears the set
+void draw_dirty_tris(world_t &world);
+
+// Points the LCD at VRAM. This is latched at the start of the next refresh,
+// so the switch never tears
+void show_frame();
+
+// Waits until the LCD has picked up the address from the last show_frame
+void wait_frame();
+
+// Scrolls the view by panning the displayed frame vertically through VRAM, or
+// by moving it to the other end when that can't be done off screen, and draws
+// the strips that come into view
 void scroll_view(world_t &world, int24_t x, int24_t y);
 
+// Moves the frame back to BUFFER_1 and points graphx at BUFFER_2, which is
+// where the rest of the UI expects things to be
+void reset_view();
+
+// Resets the view, then leaves a dimmed copy of the frame in BUFFER_2
 void dim_screen();
 
 void draw_num(int24_t x, int24_t y, uint8_t n);
@@ -0,0 +1,64 @@
+#pragma once
+#include <tice.h>
+#include <sys/timers.h>
+#include <string.h>
+
+// The game advances in fixed ticks timed by hardware timer 1 on the 32KHz
+// clock, so scrolling runs at the same speed however long a frame takes
+#define TICK_RATE 20
+#define TICK_LEN (32768 / TICK_RATE)
+
+// After a slow frame the next one catches up on the ticks it missed, but
+// never more than this many at once so one long stall can't snowball
+#define MAX_CATCHUP 3
+
+typedef struct frame_stats {
+    uint24_t frames;
+    // Frames whose work took longer than a tick
+    uint24_t over_budget;
+    // The longest frame so far, in 32KHz timer ticks
+    uint32_t worst;
+    // The most recent frame, in 32KHz timer ticks
+    uint32_t last;
+} frame_stats_t;
+
+frame_stats_t frame_stats;
+
+// Timer value at the start of the current tick and of the current frame
+uint32_t tick_start;
+uint32_t frame_start;
+
+// Starts the frame timer and clears the stats
+void frame_init() {
+    timer_Disable(1);
+    timer_Set(1, 0);
+    timer_Enable(1, TIMER_32K, TIMER_NOINT, TIMER_UP);
+
+    tick_start = 0;
+    memset(&frame_stats, 0, sizeof(frame_stats));
+}
+
+// Marks the start of a frame and returns how many ticks the game should advance
+uint8_t frame_begin() {
+    frame_start = timer_Get(1);
+
+    uint32_t ticks = (frame_start - tick_start) / TICK_LEN;
+    tick_start += ticks * TICK_LEN;
+
+    return (ticks > MAX_CATCHUP) ? MAX_CATCHUP : ticks;
+}
+
+// Records how long the frame's work took, then waits for the next tick so
+// frames are evenly paced
+void frame_end() {
+    uint32_t len = timer_Get(1) - frame_start;
+
+    frame_stats.frames++;
+    frame_stats.last = len;
+    if(len > TICK_LEN)
+        frame_stats.over_budget++;
+    if(len > frame_stats.worst)
+        frame_stats.worst = len;
+
+    while(timer_Get(1) - tick_start < TICK_LEN);
+}
@@ -7,7 +7,23 @@
 #include "world_io.h"
 #include "player.h"
 #include "ui.h"
-#include <debug.h>
+#include "frame.h"
+#include "perf.h"
+
+// Redraws the whole view from the triangle grid
+void redraw_world(world_t *world, player_t &player) {
+    memset(VRAM, SKY, LCD_CNT);
+    
+    draw_x0 = 0;
+    draw_y0 = 0;
+    draw_x1 = LCD_WIDTH;
+    draw_y1 = LCD_HEIGHT;
+
+    draw_tri_grid(*world);
+    world->clear_dirty();
+
+    player.draw();
+}
 
 void init_play(uint8_t world_id, world_t *world, player_t &player) {
     
@@ -17,73 +33,40 @@ void init_play(uint8_t world_id, world_t *world, player_t &player) {
     // Try to load the world file, and otherwise generate a new one
     if(!load(world_id, *world, player)) {
         const char* options[4] = {"What type of world?", "Natural", "Flat", "Demo"};
+        uint8_t type = menu(options, 3);
 
-        switch(menu(options, 3)) {
-            case 0:
-                generate_natural(*world, player);
-                break;
-            case 1:
-                generate_flat(*world, player);
-                break;
-            case 2:
-                generate_demo(*world, player);
-                break;
+        const char* sizes[3] = {"What size of world?", "48x48", "144x144"};
+        uint8_t map_chunks = menu(sizes, 2) ? MAX_MAP_CHUNKS : WINDOW_CHUNKS;
+
+        gfx_FillScreen(1);
+        progress_bar("Generating world...");
+
+        // Without the room to save a bigger map, settle for one the size of the window
+        if(!generate_map(world_id, *world, player, type, map_chunks)) {
+            erase_chunks(world_id);
+            generate_map(world_id, *world, player, type, WINDOW_CHUNKS);
         }
 
         player.scroll_to_center(scroll_x, scroll_y);
-    }
 
-    gfx_FillScreen(1);
-    progress_bar("Building world...");
-    
-    progress_bar("Initializing shadows...");
-    // Initialize the shadow triangle grid with data from the world
-    for(int y = 0; y < WORLD_HEIGHT; y++) {
-        fill_progress_bar(y, WORLD_HEIGHT + WORLD_HEIGHT);
-        for(int z = 0; z < WORLD_SIZE; z++) {
-            for(int x = 0; x < WORLD_SIZE; x++) {
-                if(world->blocks[y][x][z] > WATER) {
-                    world->set_block_shadow(x, y, z);
-                }
-            }
-        }
-    }
+        gfx_FillScreen(1);
+        progress_bar("Building world...");
 
-    progress_bar("Initializing blocks...");
-    // Initialize the triangle grid with data from the world
-    for(int y = 0; y < WORLD_HEIGHT; y++) {
-        fill_progress_bar(y + WORLD_HEIGHT, WORLD_HEIGHT + WORLD_HEIGHT);
-        for(int z = WORLD_SIZE - 1; z >= 0; z--) {
-            for(int x = WORLD_SIZE - 1; x >= 0; x--) {
-                if(world->blocks[y][x][z] == WATER) {
-                    world->set_water(x, y, z);
-                }
-                else if(world->blocks[y][x][z] != AIR) {
-                    world->set_block(x, y, z, world->blocks[y][x][z]);
-                }
-            }
-        }
+        // Fill the triangle grid and shadow map with data from the world
+        world->build_tri_grid();
     }
-    
+
     init_palette();
-    memset(VRAM, SKY, LCD_CNT);
-    
-    draw_x0 = 0;
-    draw_y0 = 0;
-    draw_x1 = LCD_WIDTH;
-    draw_y1 = LCD_HEIGHT;
 
     gfx_SetDrawBuffer();
-    draw_tri_grid(*world);
-
-    player.draw();
+    clear_tri_cache();
+    redraw_world(world, player);
 }
 
 void play(uint8_t world_id) {
-    // We store the world data at the contiguous 69K of Safe RAM
-    // as listed here:
-    // https://wikiti.brandonw.net/index.php?title=Category:84PCE:RAM:By_Address
-    world_t* world = (world_t*)0xD05350;
+    // We store the world data at the start of the contiguous 69K of Safe
+    // RAM (see arena.h)
+    world_t* world = (world_t*)WORLD_RAM.base;
     player_t player;
     player.current_block = STONE;
 
@@ -95,9 +78,22 @@ void play(uint8_t world_id) {
     player.world = world;
 
     sk_key_t key;
+
+    // Ticks since the world was last saved in the background
+    uint24_t autosave_ticks = 0;
+
+    frame_init();
+#ifdef PERF_HUD
+    perf_init();
+#endif
     
     do
     {
+        uint8_t ticks = frame_begin();
+#ifdef PERF_HUD
+        perf_begin_frame(*world);
+#endif
+
         key = os_GetCSC();
 
         switch (key)
@@ -160,19 +156,22 @@ void play(uint8_t world_id) {
 
             // Block placement or removal
             case sk_5:
-                // Initialize our update region to be empty
-                empty_draw_region();
+                // The cursor is drawn over this block, so always repaint it
+                world->mark_block_dirty(player.x, player.y, player.z);
 
-                // Place or remove block will expand the update region to contain all updated
-                // blocks (where a shadow is cast or uncast)
+                // Place or remove block will mark every triangle they change as dirty
+                // (including where a shadow is cast or uncast)
                 if(player.current_block != WATER) {
-                    if(world->blocks[player.y][player.x][player.z] == AIR) {
+                    if(world->block_at(player.x, player.y, player.z) == AIR) {
                         world->place_block(player.x, player.y, player.z, player.current_block);
                     }
-                    // Just replace water with solid blocks when placing (double tap 5 to replace water with air)
-                    else if(world->blocks[player.y][player.x][player.z] == WATER) {
-                        world->remove_block(player.x, player.y, player.z);
-                        world->place_block(player.x, player.y, player.z, player.current_block);
+                    // Just replace water with solid blocks when placing (double tap 5 to replace water with air).
+                    // As one edit this retraces each triangle once, rather than
+                    // removing the water and placing the block separately
+                    else if(world->block_at(player.x, player.y, player.z) == WATER) {
+                        world->begin_edit();
+                        world->edit_block(player.x, player.y, player.z, player.current_block);
+                        world->commit_edit();
                     }
                     else {
                         world->remove_block(player.x, player.y, player.z);
@@ -180,17 +179,16 @@ void play(uint8_t world_id) {
                 }
                 else
                 {
-                    if(world->blocks[player.y][player.x][player.z] == AIR) {
+                    if(world->block_at(player.x, player.y, player.z) == AIR) {
                         world->set_water(player.x, player.y, player.z);
-                        expand_draw_region(player.x, player.y, player.z);
                     }
                     else {
                         world->remove_block(player.x, player.y, player.z);
                     }
                 }
                 
-                // Redraw the section of the screen where updates occurred and the cursor on top of that
-                draw_tri_grid(*world);
+                // Redraw the triangles that changed and the cursor on top of that
+                draw_dirty_tris(*world);
                 player.draw();
                 break;
 
@@ -204,28 +202,61 @@ void play(uint8_t world_id) {
                 break;
         }
 
+        // Bring in more of the map once the player nears the edge of what's loaded
+        int24_t old_scroll_x = scroll_x;
+        int24_t old_scroll_y = scroll_y;
+
+        if(follow_player(world_id, *world, player)) {
+            scroll_goal_x += scroll_x - old_scroll_x;
+            scroll_goal_y += scroll_y - old_scroll_y;
+            redraw_world(world, player);
+        }
+        else if(page_failed) {
+            page_failed = false;
+            play_message("Couldn't load more of the map");
+        }
+
         // Compute the motion needed to reach our scroll target
         int24_t scroll_step_x = scroll_goal_x - scroll_x;
         int24_t scroll_step_y = scroll_goal_y - scroll_y;
 
-        // Clamp it to the max scroll speed
-        if(scroll_step_x > SCROLL_SPEED)
-            scroll_step_x = SCROLL_SPEED;
-        if(scroll_step_x < -SCROLL_SPEED)
-            scroll_step_x = -SCROLL_SPEED;
+        // Clamp it to the max scroll speed for the ticks that have passed
+        int24_t max_step = ticks * SCROLL_SPEED;
+
+        if(scroll_step_x > max_step)
+            scroll_step_x = max_step;
+        if(scroll_step_x < -max_step)
+            scroll_step_x = -max_step;
 
-        if(scroll_step_y > SCROLL_SPEED)
-            scroll_step_y = SCROLL_SPEED;
-        if(scroll_step_y < -SCROLL_SPEED)
-            scroll_step_y = -SCROLL_SPEED;
+        if(scroll_step_y > max_step)
+            scroll_step_y = max_step;
+        if(scroll_step_y < -max_step)
+            scroll_step_y = -max_step;
 
         if(scroll_step_x != 0 || scroll_step_y != 0){
             scroll_view(*world, scroll_step_x, scroll_step_y);
             player.draw();
         }
 
+#ifdef PERF_HUD
+        perf_draw_hud();
+#endif
+
+        // Only the slices with changes get rewritten, so saving every so
+        // often is cheap as long as there's something to save. It all stays
+        // in RAM until the save on quitting archives it
+        autosave_ticks += ticks;
+        if(autosave_ticks >= AUTOSAVE_SECONDS * TICK_RATE) {
+            autosave_ticks = 0;
+            if(world->any_slice_dirty())
+                save(world_id, *world, player, true);
+        }
+
+        frame_end();
+
     } while (key != sk_2nd);
 
+    reset_view();
 
     init_ui_palette();
     gfx_SetDrawScreen();
@@ -236,6 +267,24 @@ void play(uint8_t world_id) {
     save(world_id, *world, player);
 }
 
+// Writes the dimensions of a map map_chunks chunks across, like "48x16x48"
+void map_size_label(char *label, uint8_t map_chunks) {
+    uint24_t sizes[3] = {(uint24_t)map_chunks * CHUNK_SIZE, WORLD_HEIGHT, (uint24_t)map_chunks * CHUNK_SIZE};
+
+    for(uint8_t i = 0; i < 3; i++) {
+        char digits[8];
+        uint8_t n = 0;
+        do {
+            digits[n++] = '0' + sizes[i] % 10;
+            sizes[i] /= 10;
+        } while(sizes[i] > 0);
+
+        while(n > 0)
+            *label++ = digits[--n];
+        *label++ = (i < 2) ? 'x' : '\0';
+    }
+}
+
 void world_select() {
     uint8_t selection = 0;
 
@@ -267,8 +316,11 @@ void world_select() {
             {
                 gfx_SetTextFGColor(0);
                 gfx_PrintStringXY(name, UI_BORDER + 16, UI_BORDER + 16 + i * 32);
+                char size[16];
+                map_size_label(size, saved_map_chunks(var));
+
                 gfx_SetTextFGColor(3);
-                gfx_PrintStringXY("48x16x48", UI_BORDER + 24, UI_BORDER + 24 + i * 32);
+                gfx_PrintStringXY(size, UI_BORDER + 24, UI_BORDER + 24 + i * 32);
                 ti_Close(var);
             }
 
@@ -355,8 +407,6 @@ void init () {
 
 int main(void)
 {
-    static_assert(sizeof(world_t) < 69090, "World_t size is too big for the specified SafeRAM area!");
-    
     init();
 
     gfx_End();
@@ -0,0 +1,84 @@
+#pragma once
+#ifdef PERF_HUD
+#include <tice.h>
+#include <graphx.h>
+#include <sys/timers.h>
+#include <string.h>
+#include "draw.h"
+#include "frame.h"
+
+// The HUD is drawn over the top left corner of the screen, one row per value
+#define HUD_ROWS (PERF_CNT + 4)
+#define HUD_WIDTH 40
+#define HUD_HEIGHT (8 * HUD_ROWS)
+
+// Clock rate of timer 2, which counts CPU cycles
+#define PERF_CPU_HZ 48000000
+
+const char* hud_labels[HUD_ROWS] = {
+    "FP", "MS", "WF", "OB",
+    "GR", "SC", "SS", "PL", "PB", "RB", "SH", "ST"
+};
+
+// Where the previous frame started, to work out the frame rate
+uint32_t hud_last_start;
+
+// Starts the cycle counter used by PERF_SCOPE
+void perf_init() {
+    timer_Disable(2);
+    timer_Set(2, 0);
+    timer_Enable(2, TIMER_CPU, TIMER_NOINT, TIMER_UP);
+
+    hud_last_start = frame_start;
+    memset(perf_cycles, 0, sizeof(perf_cycles));
+}
+
+// Redraws the world under the HUD so it doesn't get carried along by the next
+// scroll, then clears the counters for the frame. Call after frame_begin()
+void perf_begin_frame(world_t &world) {
+    uint16_t x0 = draw_x0, y0 = draw_y0, x1 = draw_x1, y1 = draw_y1;
+
+    draw_x0 = 0;
+    draw_y0 = 0;
+    draw_x1 = HUD_WIDTH;
+    draw_y1 = HUD_HEIGHT;
+    draw_tri_grid(world);
+
+    draw_x0 = x0;
+    draw_y0 = y0;
+    draw_x1 = x1;
+    draw_y1 = y1;
+
+    memset(perf_cycles, 0, sizeof(perf_cycles));
+}
+
+static uint8_t hud_clamp(uint32_t n) {
+    return (n > 255) ? 255 : n;
+}
+
+// Draws the frame rate, the last and worst frames' lengths, how many frames
+// went over a tick, and the time spent in each subsystem this frame. Times are
+// in milliseconds. Call once the frame is drawn
+void perf_draw_hud() {
+    uint8_t values[HUD_ROWS];
+
+    uint32_t period = frame_start - hud_last_start;
+    hud_last_start = frame_start;
+
+    values[0] = hud_clamp(period ? 32768 / period : 0);
+    values[1] = hud_clamp(frame_stats.last * 1000 / 32768);
+    values[2] = hud_clamp(frame_stats.worst * 1000 / 32768);
+    values[3] = hud_clamp(frame_stats.over_budget);
+    for(uint8_t i = 0; i < PERF_CNT; i++)
+        values[i + 4] = hud_clamp(perf_cycles[i] / (PERF_CPU_HZ / 1000));
+
+    for(uint8_t i = 0; i < HUD_ROWS; i++) {
+        gfx_SetDrawScreen();
+        gfx_SetColor(SKY);
+        gfx_FillRectangle(0, 8 * i, 16, 8);
+        gfx_PrintStringXY(hud_labels[i], 0, 8 * i);
+        draw_num(16, 8 * i, values[i]);
+    }
+}
+
+#endif
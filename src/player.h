@@ -24,6 +24,8 @@ typedef struct player {
     }
 
     void draw() {
+        PERF_SCOPE(PERF_PLAYER);
+
         int24_t screen_x = scroll_x + 160 + (16 * x) - (16 * z);
         int24_t screen_y = scroll_y + 209 -  (8 * x) -  (8 * z) - (16 * y);
 
@@ -33,42 +35,42 @@ typedef struct player {
 
 
         // Draw Back Texture
-        if(world->tri_grid_depth[tri_grid_idx] > depth)
+        if(world->cell_depth(tri_grid_idx) > depth)
             draw_left_triangle(screen_x,  screen_y, 
                                player_tex[RIGHT_FACE * 2],     
                                SHADOW);
         
         tri_grid_idx++;
 
-        if(world->tri_grid_depth[tri_grid_idx] > depth)
+        if(world->cell_depth(tri_grid_idx) > depth)
             draw_right_triangle(screen_x, screen_y, 
                                 player_tex[LEFT_FACE * 2 + 1], 
                                 SHADOW);
 
         tri_grid_idx = world->project(x, y, z, MID_FACE);
 
-        if(world->tri_grid_depth[tri_grid_idx] > depth)
+        if(world->cell_depth(tri_grid_idx) > depth)
             draw_right_triangle(screen_x - 16, screen_y + 8, 
                                 player_tex[RIGHT_FACE * 2 + 1], 
                                 SHADOW);
         
         tri_grid_idx++;
         
-        if(world->tri_grid_depth[tri_grid_idx] > depth)
+        if(world->cell_depth(tri_grid_idx) > depth)
             draw_left_triangle(screen_x + 16,  screen_y + 8, 
                                player_tex[LEFT_FACE * 2],     
                                SHADOW);
 
         tri_grid_idx = world->project(x, y, z, BOT_FACE);
 
-        if(world->tri_grid_depth[tri_grid_idx] > depth)
+        if(world->cell_depth(tri_grid_idx) > depth)
             draw_left_triangle(screen_x,  screen_y + 16, 
                                player_tex[TOP_FACE * 2],     
                                SHADOW);
         
         tri_grid_idx++;
         
-        if(world->tri_grid_depth[tri_grid_idx] > depth)
+        if(world->cell_depth(tri_grid_idx) > depth)
             draw_right_triangle(screen_x, screen_y + 16, 
                                 player_tex[TOP_FACE * 2 + 1], 
                                 SHADOW);
@@ -83,40 +85,42 @@ typedef struct player {
         
         draw_left_triangle(screen_x,  screen_y, 
                            player_tex[TOP_FACE * 2],
-                           world->tri_grid_depth[tri_grid_idx] >= depth ? 0 : SHADOW);
+                           world->cell_depth(tri_grid_idx) >= depth ? 0 : SHADOW);
         
         tri_grid_idx++;
 
         draw_right_triangle(screen_x, screen_y, 
                             player_tex[TOP_FACE * 2 + 1], 
-                            world->tri_grid_depth[tri_grid_idx] >= depth ? 0 : SHADOW);
+                            world->cell_depth(tri_grid_idx) >= depth ? 0 : SHADOW);
 
         tri_grid_idx = world->project(x, y, z, MID_FACE);
 
         draw_right_triangle(screen_x - 16, screen_y + 8, 
                             player_tex[LEFT_FACE * 2 + 1], 
-                            world->tri_grid_depth[tri_grid_idx] >= depth ? 0 : SHADOW);
+                            world->cell_depth(tri_grid_idx) >= depth ? 0 : SHADOW);
         
         tri_grid_idx++;
         
         draw_left_triangle(screen_x + 16,  screen_y + 8, 
                            player_tex[RIGHT_FACE * 2],   
-                            world->tri_grid_depth[tri_grid_idx] >= depth ? 0 : SHADOW);
+                            world->cell_depth(tri_grid_idx) >= depth ? 0 : SHADOW);
 
         tri_grid_idx = world->project(x, y, z, BOT_FACE);
 
         draw_left_triangle(screen_x,  screen_y + 16, 
                            player_tex[LEFT_FACE * 2],   
-                           world->tri_grid_depth[tri_grid_idx] >= depth ? 0 : SHADOW);
+                           world->cell_depth(tri_grid_idx) >= depth ? 0 : SHADOW);
         
         tri_grid_idx++;
         
         draw_right_triangle(screen_x, screen_y + 16, 
                             player_tex[RIGHT_FACE * 2 + 1], 
-                            world->tri_grid_depth[tri_grid_idx] >= depth ? 0 : SHADOW);
+                            world->cell_depth(tri_grid_idx) >= depth ? 0 : SHADOW);
     }
 
     void undraw() {
+        PERF_SCOPE(PERF_PLAYER);
+
         empty_draw_region();
         expand_draw_region(x, y, z);
         draw_tri_grid(*world);
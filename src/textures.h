@@ -24,6 +24,13 @@ extern Texture_t textures[TEX_CNT];
 
 extern Texture_t player_tex;
 
+// An all-zero mask, used wherever no shadow or water is applied
+extern uint8_t empty[TEX_SIZE];
+
+// Masks that apply the same term to every pixel
+extern uint8_t full_shadow[TEX_SIZE];
+extern uint8_t full_water[TEX_SIZE];
+
 #define SHADOW_NONE 0
 #define SHADOW_BOTTOM 4
 #define SHADOW_TOP 8
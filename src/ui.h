@@ -161,7 +161,8 @@ Block_t block_select(Block_t block) {
     } while (key != sk_Enter);
     
     gfx_SetDrawBuffer();
-    VRAM = (uint8_t*)((uint24_t)VRAM ^ BUFFER_SWP);
+    // dim_screen left the game's own frame untouched in BUFFER_1
+    VRAM = (uint8_t*)BUFFER_1;
     gfx_SwapDraw();
 
     block = (row * ICON_COLS) + col + STONE;
@@ -236,4 +237,26 @@ uint8_t menu(const char **options, uint8_t option_cnt) {
     } while (key != sk_Enter);
 
     return selection;
+}
+
+// Shows a message over the dimmed game until it's dismissed, then puts the
+// game back on screen
+void play_message(const char *text) {
+    dim_screen();
+    gfx_SwapDraw();
+    gfx_SetDrawScreen();
+
+    // The dimmed game only uses the shaded half of the palette, so the UI
+    // colors can borrow the rest for now
+    init_ui_palette();
+
+    const char* options[2] = {text, "OK"};
+    menu(options, 1);
+
+    init_palette();
+
+    // dim_screen left the game's own frame untouched in BUFFER_1
+    gfx_SetDrawBuffer();
+    VRAM = (uint8_t*)BUFFER_1;
+    gfx_SwapDraw();
 }
\ No newline at end of file
@@ -6,58 +6,28 @@
 #include "block.h"
 #include "textures.h"
 
-/* The projected depth of each block from the view of the sun.
-*  
-*  There was not a large enough contiguous piece of memory to include this in the 
-*  world struct.
-*
-*  I just put this in a random spot in RAM that looked open, that could
-*  very well be a mistake
-*/
-uint8_t *tri_grid_shadow = (uint8_t*)0xD3C000;
+// The row tables are built by the compiler and kept with the program
+constexpr grid_layout_t tri_geometry;
 
-/* Populates the LUTs for indexing into the trigrid */
+/* Clears the trigrid to empty sky */
 void world::init_tri_grid() {
-    // The starting index (in the overall array) of this row
-    int idx = 0;
-    // The width in triangles of this row
-    int width = 0;
-    // Bottom diamond
-    for(int row = 0; row < WORLD_SIZE; row++) {
-        // Width increases with each row
-        width += 2;
-        // Store the start index of this row, and compute the index for the next row
-        tri_grid_rows[row] = idx;
-        idx += width;
-        // Compute the pixel offset of the leftmost trangle based on the width of the row
-        tri_grid_row_px_offset[row] = (width * 8) - 16;
-        // Compute the trigrid offset based on how this row width deviates from the width
-        // of an infinite trigrid
-        tri_grid_row_offset[row] = (width - (2 * row + 2)) / 2;
-        
-        tri_grid_row_width[row] = width;
-    }
-    // Middle rows (same as above, but width is constant)
-    for(int row = WORLD_SIZE; row < WORLD_SIZE + WORLD_HEIGHT + WORLD_HEIGHT - 1; row++) {
-        tri_grid_rows[row] = idx;
-        idx += width;
-        tri_grid_row_px_offset[row] = (width * 8) - 16;
-        tri_grid_row_offset[row] = (width - (2 * row + 2)) / 2;
-        tri_grid_row_width[row] = width;
-    }
-    // Upper diamond (same as above, but width decreases)
-    for(int row = WORLD_SIZE + WORLD_HEIGHT + WORLD_HEIGHT - 1; row < ROW_CNT; row++) {
-        tri_grid_rows[row] = idx;
-        idx += width;
-        tri_grid_row_px_offset[row] = (width * 8) - 16;
-        tri_grid_row_offset[row] = (width - (2 * row + 2)) / 2;
-        tri_grid_row_width[row] = width;
-        width -= 2;
-    }
     // Clear the trigrid
+#ifdef TRI_CELLS
+    for(int i = 0; i < TRI_CNT; i++) {
+        tri_grid[i].tex = AIR;
+        tri_grid[i].flags = 0;
+        tri_grid[i].depth = 255;
+    }
+#else
     memset(tri_grid_tex, AIR, TRI_CNT);
     memset(tri_grid_flags, 0, TRI_CNT);
     memset(tri_grid_depth, 255, TRI_CNT);
+#endif
+    clear_dirty();
+#ifdef TRI_RUNS
+    // Every triangle is now empty sky, so every triangle matches the next pair
+    memset(tri_grid_run, 0xFF, sizeof(tri_grid_run));
+#endif
     memset(tri_grid_shadow, 255, TRI_CNT);
 }
 
@@ -70,7 +40,7 @@ bool world::sweep_ray(int x, int y, int z, int dx, int dy, int dz) {
     int by = y;
     int bz = z;
     while(0 <= bx && bx < WORLD_SIZE && 0 <= by && by < WORLD_HEIGHT && 0 <= bz && bz < WORLD_SIZE) {
-        if(blocks[by][bx][bz] != AIR) return true;
+        if(by < column_height[bx][bz] && block_at(bx, by, bz) != AIR) return true;
         bx += dx;
         by += dy;
         bz += dz;
@@ -92,8 +62,8 @@ uint8_t world::compute_top_shadow(uint8_t x, uint8_t y, uint8_t z) {
     
     // We then turn these rules into a linear transformation
     int row = sx + sy + sy + sz + 2;
-    int idx = sx + sx + sy + sy + tri_grid_row_offset[row] + 2;
-    int tri_grid_idx = tri_grid_rows[row] + idx;
+    int idx = sx + sx + sy + sy + tri_geometry.row_offset[row] + 2;
+    int tri_grid_idx = tri_geometry.rows[row] + idx;
     
     if(tri_grid_shadow[tri_grid_idx] < depth) 
         shadow |= SHADOW_TOP;
@@ -117,16 +87,16 @@ uint8_t world::compute_left_shadow(uint8_t x, uint8_t y, uint8_t z) {
     
     // We then turn these rules into a linear transformation        
     int row = sx + sy + sy + sz + 1;
-    int idx = sx + sx + sy + sy + tri_grid_row_offset[row] + 2;
-    int tri_grid_idx = tri_grid_rows[row] + idx;
+    int idx = sx + sx + sy + sy + tri_geometry.row_offset[row] + 2;
+    int tri_grid_idx = tri_geometry.rows[row] + idx;
     
     if(tri_grid_shadow[tri_grid_idx] < depth) 
         shadow |= SHADOW_TOP;
     
     // We then turn these rules into a linear transformation
     row = sx + sy + sy + sz + 0;
-    idx = sx + sx + sy + sy + tri_grid_row_offset[row] + 1;
-    tri_grid_idx = tri_grid_rows[row] + idx;
+    idx = sx + sx + sy + sy + tri_geometry.row_offset[row] + 1;
+    tri_grid_idx = tri_geometry.rows[row] + idx;
     
     if(tri_grid_shadow[tri_grid_idx] < depth) 
         shadow |= SHADOW_BOTTOM;
@@ -143,27 +113,141 @@ uint8_t world::compute_left_shadow(uint8_t x, uint8_t y, uint8_t z) {
 */
 int world::project(uint8_t x, uint8_t y, uint8_t z, uint8_t s) {
     int row = x + y + y + z + s;
-    int idx = x + x + y + y + tri_grid_row_offset[row] + s;
-    return tri_grid_rows[row] + idx;
+    int idx = x + x + y + y + tri_geometry.row_offset[row] + s;
+    return tri_geometry.rows[row] + idx;
 }
 
-void world::unproject(int row, int idx, int depth, uint8_t &x, uint8_t &y, uint8_t &z) {
-    int A = row;
-    int B = idx - tri_grid_row_offset[row];
+// The numerators of the inverse projection, each of which is divided by 6.
+// B is the triangle's index with its row's offset taken off
+static void unproject_terms(int A, int B, int depth, int terms[3]) {
     int C = depth - (WORLD_HEIGHT - 1);
     // Little offset to fix the rounding error from the inversion
     // I worked this out through trial and error, but I believe it
     // accounts for left and right facing triangles.
     uint8_t z_offset = B % 2 == 0 ? 2 : 4;
     // Compute the inverse projection transformation
-    x = (-2 * A + 3 * B + 2 * C) / 6;
-    y = ( 2 * A + 0 * B - 2 * C) / 6;
-    z = ( 4 * A - 3 * B + 2 * C + z_offset) / 6;
+    terms[0] = -2 * A + 3 * B + 2 * C;
+    terms[1] =  2 * A + 0 * B - 2 * C;
+    terms[2] =  4 * A - 3 * B + 2 * C + z_offset;
+}
+
+void world::unproject(int row, int idx, int depth, uint8_t &x, uint8_t &y, uint8_t &z) {
+    int terms[3];
+    unproject_terms(row, idx - tri_geometry.row_offset[row], depth, terms);
+    x = terms[0] / 6;
+    y = terms[1] / 6;
+    z = terms[2] / 6;
+}
+
+/* Walks the positions unproject() gives for a triangle at each depth in turn.
+*  Every step of depth adds 2, -2 and 2 to the x, y and z numerators, so rather
+*  than dividing by 6 (which the eZ80 does in software) each step carries the
+*  remainders into the quotients. Remainders take the sign of their numerator
+*  to round toward zero the same way the division does
+*/
+typedef struct tri_walk {
+    int q[3];
+    int r[3];
+} tri_walk_t;
+
+static void start_walk(tri_walk_t &walk, int A, int B, int depth) {
+    int terms[3];
+    unproject_terms(A, B, depth, terms);
+    for(uint8_t i = 0; i < 3; i++) {
+        walk.q[i] = terms[i] / 6;
+        walk.r[i] = terms[i] % 6;
+    }
+}
+
+static inline void walk_up(int &q, int &r) {
+    r += 2;
+    if(r >= 6 || (q < 0 && r > 0)) {
+        q++;
+        r -= 6;
+    }
+}
+
+static inline void walk_down(int &q, int &r) {
+    r -= 2;
+    if(r <= -6 || (q > 0 && r < 0)) {
+        q--;
+        r += 6;
+    }
+}
+
+// Moves the walk one step deeper
+static inline void step_walk(tri_walk_t &walk) {
+    walk_up(walk.q[0], walk.r[0]);
+    walk_down(walk.q[1], walk.r[1]);
+    walk_up(walk.q[2], walk.r[2]);
+}
+
+static inline bool walk_inside(const tri_walk_t &walk) {
+    return (unsigned)walk.q[0] < WORLD_SIZE && (unsigned)walk.q[1] < WORLD_HEIGHT && (unsigned)walk.q[2] < WORLD_SIZE;
+}
+
+/* Starts a walk at the given depth, or further along if that skips only
+*  positions at or above max_height, which are all empty. The first position
+*  below max_height is at depth A + WORLD_HEIGHT - 3 * max_height. Along a ray x and z only grow
+*  and y only shrinks, so if both ends of the jump are inside the world
+*  everything in between is too, and the jump can't pass the point where a
+*  walk leaving the world would have stopped
+*/
+static void start_walk_below(tri_walk_t &walk, int A, int B, int depth, uint8_t max_height) {
+    start_walk(walk, A, B, depth);
+
+    int below = A + WORLD_HEIGHT - 3 * max_height;
+    if(depth >= below || !walk_inside(walk)) return;
+
+    tri_walk_t ahead;
+    start_walk(ahead, A, B, below);
+    if(walk_inside(ahead))
+        walk = ahead;
+}
+
+#ifdef TRI_RUNS
+// Recomputes the run bit of a single triangle
+void world::update_run(int tri_grid_idx) {
+    // Bits at the end of a row compare against the next row, which is harmless
+    // since the renderer never extends a run past the end of a row
+    if(tri_grid_idx + 2 < TRI_CNT &&
+       cell_tex(tri_grid_idx) == cell_tex(tri_grid_idx + 2) &&
+       cell_flags(tri_grid_idx) == cell_flags(tri_grid_idx + 2))
+        tri_grid_run[tri_grid_idx >> 3] |= 1 << (tri_grid_idx & 7);
+    else
+        tri_grid_run[tri_grid_idx >> 3] &= ~(1 << (tri_grid_idx & 7));
+}
+
+// Recomputes every run bit from the current grid
+void world::init_tri_runs() {
+    for(int i = 0; i < TRI_CNT; i++)
+        update_run(i);
+}
+#endif
+
+// Must be called after a triangle's texture or flags are changed
+void world::tri_changed(int tri_grid_idx) {
+    mark_dirty(tri_grid_idx);
+#ifdef TRI_RUNS
+    // Both this triangle and the one two before it compare against it
+    if(tri_grid_idx >= 2)
+        update_run(tri_grid_idx - 2);
+    update_run(tri_grid_idx);
+#endif
+}
+
+// Marks all 6 triangles a block projects to, whether or not it is visible
+void world::mark_block_dirty(int x, int y, int z) {
+    for(uint8_t s = 0; s < 3; s++) {
+        int tri_grid_idx = project(x, y, z, s);
+        mark_dirty(tri_grid_idx);
+        mark_dirty(tri_grid_idx + 1);
+    }
 }
 
 // Adds this block to the world's data structures and applies any necessary masks
 void world::set_block(int x, int y, int z, Block_t block) {
-    blocks[y][x][z] = block;
+    store_block(x, y, z, block);
     
     // A lookup table for the order of faces we draw
     uint8_t faces[6] = {LEFT_FACE, RIGHT_FACE, LEFT_FACE, RIGHT_FACE, TOP_FACE, TOP_FACE};
@@ -181,15 +265,15 @@ void world::set_block(int x, int y, int z, Block_t block) {
         int tri_grid_idx = project(x, y, z, s);
         for(int t = 0; t < 2; t++) {
             uint8_t depth = block_depth;
-            uint8_t tri_depth = tri_grid_depth[tri_grid_idx];
+            uint8_t tri_depth = cell_depth(tri_grid_idx);
             uint8_t water = WATER_NONE;
             
             // If the face is occluded, but the cell is flagged with water
             // manually search for the frontmost solid block face to check if
             // this face is really occluded
-            if(tri_depth < depth && tri_grid_flags[tri_grid_idx] & WATER_MASK) {
+            if(tri_depth < depth && cell_flags(tri_grid_idx) & WATER_MASK) {
                 int row = x + y + y + z + s;
-                int idx = x + x + y + y + tri_grid_row_offset[row] + s + t;
+                int idx = x + x + y + y + tri_geometry.row_offset[row] + s + t;
                 uint8_t ux, uy, uz;
                 if(scan_tri(row, idx, tri_depth, ux, uy, uz, WATER)) {
                     tri_depth = project_view_depth(ux, uy, uz);
@@ -197,15 +281,19 @@ void world::set_block(int x, int y, int z, Block_t block) {
 
                 // If this block is below water level, just copy the water flags already
                 // in this triangle
-                water = tri_grid_flags[tri_grid_idx] & WATER_MASK;
-                depth = tri_grid_depth[tri_grid_idx];
+                water = cell_flags(tri_grid_idx) & WATER_MASK;
+                depth = cell_depth(tri_grid_idx);
             }
 
             if(tri_depth >= block_depth) {
                 uint8_t face = faces[i];
-                tri_grid_tex[tri_grid_idx] = block;
-                tri_grid_flags[tri_grid_idx] = face | face_shadows[face] | water;
-                tri_grid_depth[tri_grid_idx] = depth;
+                uint8_t flags = face | face_shadows[face] | water;
+                bool changed = cell_tex(tri_grid_idx) != block || cell_flags(tri_grid_idx) != flags;
+                cell_tex(tri_grid_idx) = block;
+                cell_flags(tri_grid_idx) = flags;
+                cell_depth(tri_grid_idx) = depth;
+                if(changed)
+                    tri_changed(tri_grid_idx);
             }
             tri_grid_idx++;
             i++;
@@ -216,7 +304,7 @@ void world::set_block(int x, int y, int z, Block_t block) {
 
 // Recomputes which shadow masks should be used for the block at the given position
 void world::refresh_shadows(int x, int y, int z) {
-    expand_draw_region(x, y, z);
+    PERF_SCOPE(PERF_SHADOWS);
 
     uint8_t top_shadow  = compute_top_shadow(x, y, z);
     uint8_t left_shadow = compute_left_shadow(x, y, z);
@@ -227,14 +315,14 @@ void world::refresh_shadows(int x, int y, int z) {
         int tri_grid_idx = project(x, y, z, s);
 
         for(uint8_t t = 0; t < 2; t++) {
-            uint8_t tri_depth = tri_grid_depth[tri_grid_idx];
+            uint8_t tri_depth = cell_depth(tri_grid_idx);
 
             // If the face is occluded, but the cell is flagged with water
             // manually search for the frontmost solid block face to check if
             // this face is really occluded
-            if(tri_depth < depth && tri_grid_flags[tri_grid_idx] & WATER_MASK) {
+            if(tri_depth < depth && cell_flags(tri_grid_idx) & WATER_MASK) {
                 int row = x + y + y + z + s;
-                int idx = x + x + y + y + tri_grid_row_offset[row] + s + t;
+                int idx = x + x + y + y + tri_geometry.row_offset[row] + s + t;
                 uint8_t ux, uy, uz;
                 if(scan_tri(row, idx, tri_depth, ux, uy, uz, WATER)) {
                     tri_depth = project_view_depth(ux, uy, uz);
@@ -242,15 +330,21 @@ void world::refresh_shadows(int x, int y, int z) {
             }
 
             if(tri_depth == depth) {
-                uint8_t face = tri_grid_flags[tri_grid_idx] & FACE_MASK;
+                uint8_t flags = cell_flags(tri_grid_idx);
+                uint8_t face = flags & FACE_MASK;
 
                 if(face == TOP_FACE) {
-                    tri_grid_flags[tri_grid_idx] &= ~SHADOW_MASK;
-                    tri_grid_flags[tri_grid_idx] |= top_shadow;
+                    flags &= ~SHADOW_MASK;
+                    flags |= top_shadow;
                 }
                 if(face == LEFT_FACE) {
-                    tri_grid_flags[tri_grid_idx] &= ~SHADOW_MASK;
-                    tri_grid_flags[tri_grid_idx] |= left_shadow;
+                    flags &= ~SHADOW_MASK;
+                    flags |= left_shadow;
+                }
+
+                if(cell_flags(tri_grid_idx) != flags) {
+                    cell_flags(tri_grid_idx) = flags;
+                    tri_changed(tri_grid_idx);
                 }
             }
             tri_grid_idx++;
@@ -258,40 +352,90 @@ void world::refresh_shadows(int x, int y, int z) {
     }
 }
 
-// Adds a water block to the world's data structures and applies the water mask where appropriate
-void world::set_water(int x, int y, int z) {
-    blocks[y][x][z] = WATER;
-
-    uint8_t water_left[3]  = { WATER_FULL, WATER_FULL, WATER_FULL };
-    uint8_t water_right[3] = { WATER_FULL, WATER_FULL, WATER_FULL };
+// Works out which water mask pattern should be used on each of the triangles a water block covers
+void world::compute_water(int x, int y, int z, uint8_t water_left[3], uint8_t water_right[3]) {
+    for(uint8_t s = 0; s < 3; s++) {
+        water_left[s] = WATER_FULL;
+        water_right[s] = WATER_FULL;
+    }
 
-    // Some logic to determine which water mask pattern should be used on the triangles this block covers
-    if((y == WORLD_HEIGHT - 1) || (blocks[y + 1][x][z] != WATER)) {    
-        if((z == WORLD_SIZE - 1) || (blocks[y][x][z + 1] != WATER))
+    if((y == WORLD_HEIGHT - 1) || (block_at(x, y + 1, z) != WATER)) {    
+        if((z == WORLD_SIZE - 1) || (block_at(x, y, z + 1) != WATER))
             water_left[MID_FACE]  = WATER_HALF;
-        if((x == WORLD_SIZE - 1) || (blocks[y][x + 1][z] != WATER))
+        if((x == WORLD_SIZE - 1) || (block_at(x + 1, y, z) != WATER))
             water_right[MID_FACE] =  WATER_HALF;
 
-        if((water_left[MID_FACE] == WATER_HALF) || (x == WORLD_SIZE - 1) || (blocks[y][x + 1][z + 1] != WATER))
+        if((water_left[MID_FACE] == WATER_HALF) || (x == WORLD_SIZE - 1) || (block_at(x + 1, y, z + 1) != WATER))
             water_left[TOP_FACE]  = WATER_HALF;
-        if((water_right[MID_FACE] == WATER_HALF) || (z == WORLD_SIZE - 1) || (blocks[y][x + 1][z + 1] != WATER))
+        if((water_right[MID_FACE] == WATER_HALF) || (z == WORLD_SIZE - 1) || (block_at(x + 1, y, z + 1) != WATER))
             water_right[TOP_FACE] =  WATER_HALF;
     }
+}
+
+// Adds a water block to the world's data structures and applies the water mask where appropriate
+void world::set_water(int x, int y, int z) {
+    store_block(x, y, z, WATER);
+
+    uint8_t water_left[3];
+    uint8_t water_right[3];
+    compute_water(x, y, z, water_left, water_right);
+
     uint8_t depth = project_view_depth(x, y, z);
     
     // Loop over all 6 triangles this block covers
     for(uint8_t s = 0; s < 3; s++) {
         int tri_grid_idx = project(x, y, z, s);
-        if(tri_grid_depth[tri_grid_idx] > depth) {
-            tri_grid_flags[tri_grid_idx] &= ~WATER_MASK;
-            tri_grid_flags[tri_grid_idx] |= water_left[s];
-            tri_grid_depth[tri_grid_idx] = depth;
+        if(cell_depth(tri_grid_idx) > depth) {
+            uint8_t flags = (cell_flags(tri_grid_idx) & ~WATER_MASK) | water_left[s];
+            bool changed = cell_flags(tri_grid_idx) != flags;
+            cell_flags(tri_grid_idx) = flags;
+            cell_depth(tri_grid_idx) = depth;
+            if(changed)
+                tri_changed(tri_grid_idx);
         }
         tri_grid_idx++;
-        if(tri_grid_depth[tri_grid_idx] > depth) {
-            tri_grid_flags[tri_grid_idx] &= ~WATER_MASK;
-            tri_grid_flags[tri_grid_idx] |= water_right[s];
-            tri_grid_depth[tri_grid_idx] = depth;
+        if(cell_depth(tri_grid_idx) > depth) {
+            uint8_t flags = (cell_flags(tri_grid_idx) & ~WATER_MASK) | water_right[s];
+            bool changed = cell_flags(tri_grid_idx) != flags;
+            cell_flags(tri_grid_idx) = flags;
+            cell_depth(tri_grid_idx) = depth;
+            if(changed)
+                tri_changed(tri_grid_idx);
+        }
+    }
+    refresh_near_water(x, y, z);
+}
+
+// The water blocks whose surface looks at a position, as offsets from it.
+// compute_water reads the blocks above, in front of and in front-right of each
+static const int8_t near_water[4][3] = {{0, -1, 0}, {0, 0, -1}, {-1, 0, 0}, {-1, 0, -1}};
+
+void world::refresh_near_water(int x, int y, int z) {
+    for(uint8_t i = 0; i < 4; i++) {
+        unsigned nx = x + near_water[i][0];
+        unsigned ny = y + near_water[i][1];
+        unsigned nz = z + near_water[i][2];
+        if(nx >= WORLD_SIZE || ny >= WORLD_HEIGHT || nz >= WORLD_SIZE) continue;
+        if(block_at(nx, ny, nz) != WATER) continue;
+
+        uint8_t water_left[3];
+        uint8_t water_right[3];
+        compute_water(nx, ny, nz, water_left, water_right);
+        uint8_t depth = project_view_depth(nx, ny, nz);
+
+        // Only the triangles where this is the frontmost block show its surface
+        for(uint8_t s = 0; s < 3; s++) {
+            int tri_grid_idx = project(nx, ny, nz, s);
+            for(uint8_t t = 0; t < 2; t++) {
+                if(cell_depth(tri_grid_idx) == depth && cell_flags(tri_grid_idx) & WATER_MASK) {
+                    uint8_t flags = (cell_flags(tri_grid_idx) & ~WATER_MASK) | (t ? water_right[s] : water_left[s]);
+                    if(cell_flags(tri_grid_idx) != flags) {
+                        cell_flags(tri_grid_idx) = flags;
+                        tri_changed(tri_grid_idx);
+                    }
+                }
+                tri_grid_idx++;
+            }
         }
     }
 }
@@ -302,8 +446,8 @@ void world::set_block_shadow(int x, int y, int z) {
     // Loop over all 6 triangles this block covers
     for(uint8_t s = 0; s < 3; s++) {
         int row = x + y + y + (WORLD_SIZE - 1 - z) + s;
-        int idx = (WORLD_SIZE - 1 - z)+ (WORLD_SIZE - 1 - z) + y + y + tri_grid_row_offset[row] + s;
-        int tri_grid_idx = tri_grid_rows[row] + idx;
+        int idx = (WORLD_SIZE - 1 - z)+ (WORLD_SIZE - 1 - z) + y + y + tri_geometry.row_offset[row] + s;
+        int tri_grid_idx = tri_geometry.rows[row] + idx;
         // Update the shadow depth if this block is not already in shadow
         if(tri_grid_shadow[tri_grid_idx] > depth)
             tri_grid_shadow[tri_grid_idx] = depth;
@@ -316,6 +460,8 @@ void world::set_block_shadow(int x, int y, int z) {
 // Inserts a block into the world data structures and updates any blocks
 // which may be shadowed by it
 void world::place_block(int x, int y, int z, Block_t block) {
+    PERF_SCOPE(PERF_PLACE_BLOCK);
+
     // Compute the block position along the shadow map
     uint8_t shadow_x, shadow_y, shadow_z;
     
@@ -329,9 +475,9 @@ void world::place_block(int x, int y, int z, Block_t block) {
     for(int t = 0; t < 2; t++) {
     for(int s = 0; s < 3; s++) {
         int row = shadow_x + shadow_y + shadow_y + shadow_z + s;
-        int idx = shadow_x + shadow_x + shadow_y + shadow_y + tri_grid_row_offset[row] + s + t;
+        int idx = shadow_x + shadow_x + shadow_y + shadow_y + tri_geometry.row_offset[row] + s + t;
         int depth = project_view_depth(x, y, z);
-        depth = tri_grid_shadow[tri_grid_rows[row] + idx];
+        depth = tri_grid_shadow[tri_geometry.rows[row] + idx];
         // Reverse the projection in shadow space
         uint8_t xs, ys, zs;
         unproject(row, idx, depth, xs, ys, zs);
@@ -342,42 +488,59 @@ void world::place_block(int x, int y, int z, Block_t block) {
     
     set_block_shadow(x, y, z);
     set_block(x, y, z, block);
-    expand_draw_region(x, y, z);
-    // Make the blocks now in shadow update their shadow flags
-    for(uint8_t i = 0; i < 6; i++)
-        refresh_shadows(x_update[i], y_update[i], z_update[i]);
+    // Make the blocks now in shadow update their shadow flags. Triangles with
+    // nothing in them (depth 255) unproject to positions outside the world,
+    // which have to be skipped rather than refreshed
+    for(uint8_t i = 0; i < 6; i++) {
+        if(x_update[i] < WORLD_SIZE && y_update[i] < WORLD_HEIGHT && z_update[i] < WORLD_SIZE)
+            refresh_shadows(x_update[i], y_update[i], z_update[i]);
+    }
+    refresh_near_water(x, y, z);
 }
 
 // Search along a triangle in screen-space for the first solid block under it
 // Use skip = WATER for strictly solid blocks and skip = AIR for all non-empty blocks
 bool world::scan_tri(int row, int idx, int depth, uint8_t &x, uint8_t &y, uint8_t &z, Block_t skip) {
+    PERF_SCOPE(PERF_SCAN_TRI);
+
+    tri_walk_t walk;
+    start_walk_below(walk, row, idx - tri_geometry.row_offset[row], depth, max_height);
+
     while(true) {
-        unproject(row, idx, depth, x, y, z);
+        x = walk.q[0];
+        y = walk.q[1];
+        z = walk.q[2];
         if(x >= WORLD_SIZE || y >= WORLD_HEIGHT || z >= WORLD_SIZE) return false;
-        if(blocks[y][x][z] > skip) return true;
-        depth++;
+
+        // Above the top of its column the block can only be empty
+        if(y < column_height[x][z] && block_at(x, y, z) > skip) return true;
+        step_walk(walk);
     }
 }
 
 // Search along a triangle in shadow-space for the first solid block under it
 bool world::scan_shadow(int row, int idx, int depth, uint8_t &x, uint8_t &y, uint8_t &z) {
+    tri_walk_t walk;
+    start_walk_below(walk, row, idx - tri_geometry.row_offset[row], depth, max_height);
+
     while(true) {
-        uint8_t sx, sy, sz;
-        unproject(row, idx, depth, sx, sy, sz);
+        uint8_t sx = walk.q[0];
+        uint8_t sy = walk.q[1];
+        uint8_t sz = walk.q[2];
         if(sx >= WORLD_SIZE || sy >= WORLD_HEIGHT || sz >= WORLD_SIZE) return false;
         from_shadow_space(sx, sy, sz, x, y, z);
-        if(blocks[y][x][z] > WATER) return true;
-        depth++;
+        if(y < column_height[x][z] && block_at(x, y, z) > WATER) return true;
+        step_walk(walk);
     }
 }
 
 // Removes the block at a given position from all world data structures and updates any blocks
 // which become unshadowed
 void world::remove_block(int x, int y, int z) {
-    Block_t orig_block = blocks[y][x][z];
-    blocks[y][x][z] = AIR;
-    
-    expand_draw_region(x, y, z);
+    PERF_SCOPE(PERF_REMOVE_BLOCK);
+
+    Block_t orig_block = block_at(x, y, z);
+    store_block(x, y, z, AIR);
 
     uint8_t i = 0;
     uint8_t tri_depths[6];
@@ -388,16 +551,16 @@ void world::remove_block(int x, int y, int z) {
     for(uint8_t s = 0; s < 3; s++) {
         int tri_grid_idx = project(x, y, z, s);
         for(uint8_t t = 0; t < 2; t++) {
-            uint8_t tri_depth = tri_grid_depth[tri_grid_idx];
+            uint8_t tri_depth = cell_depth(tri_grid_idx);
             tri_depths[i++] = tri_depth;
 
             // If the face is occluded, but the cell is flagged with water
             // manually search for the frontmost solid block face to check if
             // this face is really occluded
             // Ignore this step though if we're removing a water block
-            if(tri_depth < depth && tri_grid_flags[tri_grid_idx] & WATER_MASK && (orig_block != WATER)) {
+            if(tri_depth < depth && cell_flags(tri_grid_idx) & WATER_MASK && (orig_block != WATER)) {
                 int row = x + y + y + z + s;
-                int idx = x + x + y + y + tri_grid_row_offset[row] + s + t;
+                int idx = x + x + y + y + tri_geometry.row_offset[row] + s + t;
                 uint8_t ux, uy, uz;
                 if(scan_tri(row, idx, tri_depth, ux, uy, uz, WATER)) {
                     tri_depth = project_view_depth(ux, uy, uz);
@@ -409,9 +572,12 @@ void world::remove_block(int x, int y, int z) {
             }
 
             if(tri_depth >= depth) {
-                tri_grid_tex[tri_grid_idx] = AIR;
-                tri_grid_depth[tri_grid_idx] = 255;
-                tri_grid_flags[tri_grid_idx] = 0;
+                bool changed = cell_tex(tri_grid_idx) != AIR || cell_flags(tri_grid_idx) != 0;
+                cell_tex(tri_grid_idx) = AIR;
+                cell_depth(tri_grid_idx) = 255;
+                cell_flags(tri_grid_idx) = 0;
+                if(changed)
+                    tri_changed(tri_grid_idx);
             }
             tri_grid_idx++;
         }
@@ -423,24 +589,24 @@ void world::remove_block(int x, int y, int z) {
     for(uint8_t s = 0; s < 3; s++) {
         for(uint8_t t = 0; t < 2; t++) {
             int row = x + y + y + z + s;
-            int idx = x + x + y + y + tri_grid_row_offset[row] + s + t;
+            int idx = x + x + y + y + tri_geometry.row_offset[row] + s + t;
             uint8_t ux, uy, uz;
 
             if(scan_tri(row, idx, tri_depths[i], ux, uy, uz, AIR)) {
-                if(blocks[uy][ux][uz] == WATER) {
+                if(block_at(ux, uy, uz) == WATER) {
                     uint8_t wx, wy, wz;
                     wx = ux;
                     wy = uy;
                     wz = uz;
 
                     if(scan_tri(row, idx, tri_depths[i], ux, uy, uz, WATER)) {
-                        set_block(ux, uy, uz, blocks[uy][ux][uz]);
+                        set_block(ux, uy, uz, block_at(ux, uy, uz));
                     }
                     set_water(wx, wy, wz);
                 }
                 else
                 {
-                    set_block(ux, uy, uz, blocks[uy][ux][uz]);
+                    set_block(ux, uy, uz, block_at(ux, uy, uz));
                 }
 
             }
@@ -462,30 +628,105 @@ void world::remove_block(int x, int y, int z) {
             tri_grid_shadow[tri_grid_idx] = 255;
         }
     }
-    // Redraw all the unshadowed blocks
+    // Put back the blocks now casting those shadows. A block's shadow flags
+    // read cells of the map other than its own, so every cell has to be
+    // filled in again before any flags are refreshed
+    uint8_t x_update[6];
+    uint8_t y_update[6];
+    uint8_t z_update[6];
+    bool found[6];
+    i = 0;
     for(uint8_t s = 0; s < 3; s++) {
         int row = sx + sy + sy + sz + s;
-        int idx = sx + sx + sy + sy + tri_grid_row_offset[row] + s;
-        uint8_t ux, uy, uz;
-        if(scan_shadow(row, idx, shad_depth, ux, uy, uz)) {
-            set_block_shadow(ux, uy, uz);
-            refresh_shadows(ux, uy, uz);
-        }
-        idx++;
-        if(scan_shadow(row, idx, shad_depth, ux, uy, uz)) {
-            set_block_shadow(ux, uy, uz);
-            refresh_shadows(ux, uy, uz);
+        int idx = sx + sx + sy + sy + tri_geometry.row_offset[row] + s;
+        for(uint8_t t = 0; t < 2; t++) {
+            found[i] = scan_shadow(row, idx + t, shad_depth, x_update[i], y_update[i], z_update[i]);
+            if(found[i])
+                set_block_shadow(x_update[i], y_update[i], z_update[i]);
+            i++;
         }
     }
+    // Redraw all the unshadowed blocks
+    for(i = 0; i < 6; i++) {
+        if(found[i])
+            refresh_shadows(x_update[i], y_update[i], z_update[i]);
+    }
+    refresh_near_water(x, y, z);
 }
 
 // Inclusively fills the space within the provided bounds with the specified block
 void world::fill_space(int x0, int y0, int z0, int x1, int y1, int z1, Block_t block) {
     for(int y = y0; y <= y1; y++) {
-        for(int x = x0; x <= x1; x++) {
-            for(int z = z0; z <= z1; z++) {
-                blocks[y][x][z] = block;
-            } 
+        mark_slice_dirty(y);
+        for(int cx = x0 / CHUNK_SIZE; cx <= x1 / CHUNK_SIZE; cx++) {
+            for(int cz = z0 / CHUNK_SIZE; cz <= z1 / CHUNK_SIZE; cz++) {
+                // The part of this unit that's filled
+                int ux0 = (x0 > cx * CHUNK_SIZE) ? x0 : cx * CHUNK_SIZE;
+                int uz0 = (z0 > cz * CHUNK_SIZE) ? z0 : cz * CHUNK_SIZE;
+                int ux1 = (x1 < cx * CHUNK_SIZE + CHUNK_SIZE - 1) ? x1 : cx * CHUNK_SIZE + CHUNK_SIZE - 1;
+                int uz1 = (z1 < cz * CHUNK_SIZE + CHUNK_SIZE - 1) ? z1 : cz * CHUNK_SIZE + CHUNK_SIZE - 1;
+
+                // Filling all of it leaves it all one block
+                if(ux1 - ux0 == CHUNK_SIZE - 1 && uz1 - uz0 == CHUNK_SIZE - 1) {
+                    unit_fill[unit_of(ux0, y, uz0)] = block;
+                    continue;
+                }
+
+                for(int x = ux0; x <= ux1; x++) {
+                    for(int z = uz0; z <= uz1; z++) {
+                        store_block(x, y, z, block);
+                    }
+                }
+            }
+        }
+    }
+
+    for(int x = x0 / CHUNK_SIZE; x <= x1 / CHUNK_SIZE; x++) {
+        for(int z = z0 / CHUNK_SIZE; z <= z1 / CHUNK_SIZE; z++) {
+            mark_chunk_dirty(x * CHUNK_SIZE, z * CHUNK_SIZE);
+        }
+    }
+
+    // Filling with anything but air can only raise the columns
+    for(int x = x0; x <= x1; x++) {
+        for(int z = z0; z <= z1; z++) {
+            if(block != AIR)
+                update_height(x, y1, z, block);
+            else
+                build_column(x, z);
+        }
+    }
+}
+
+void world::update_height(int x, int y, int z, Block_t block) {
+    uint8_t &height = column_height[x][z];
+
+    if(block != AIR && y >= height) {
+        height = y + 1;
+        if(height > max_height)
+            max_height = height;
+    }
+
+    // When the top block goes, look down for the next one
+    if(block == AIR && y + 1 == height) {
+        while(height > 0 && block_at(x, height - 1, z) == AIR)
+            height--;
+    }
+}
+
+void world::build_column(int x, int z) {
+    column_height[x][z] = WORLD_HEIGHT;
+    update_height(x, WORLD_HEIGHT - 1, z, AIR);
+
+    if(column_height[x][z] > max_height)
+        max_height = column_height[x][z];
+}
+
+void world::build_columns() {
+    max_height = 0;
+    for(int x = 0; x < WORLD_SIZE; x++) {
+        for(int z = 0; z < WORLD_SIZE; z++) {
+            build_column(x, z);
         }
     }
 }
@@ -496,15 +737,365 @@ void world::add_tree(int tree_x, int tree_y, int tree_z) {
     fill_space(tree_x - 2, tree_y + 3, tree_z - 2, tree_x + 2, tree_y + 4, tree_z + 2, LEAVES);
     fill_space(tree_x - 1, tree_y + 5, tree_z - 1, tree_x + 1, tree_y + 5, tree_z + 1, LEAVES);
     
-    blocks[tree_y + 6][tree_x + 1][tree_z    ] = LEAVES;
-    blocks[tree_y + 6][tree_x - 1][tree_z    ] = LEAVES;
-    blocks[tree_y + 6][tree_x    ][tree_z + 1] = LEAVES;
-    blocks[tree_y + 6][tree_x    ][tree_z - 1] = LEAVES;
-    blocks[tree_y + 6][tree_x][tree_z] = LEAVES;
+    store_block(tree_x + 1, tree_y + 6, tree_z,     LEAVES);
+    store_block(tree_x - 1, tree_y + 6, tree_z,     LEAVES);
+    store_block(tree_x,     tree_y + 6, tree_z + 1, LEAVES);
+    store_block(tree_x,     tree_y + 6, tree_z - 1, LEAVES);
+    store_block(tree_x,     tree_y + 6, tree_z,     LEAVES);
     // Add tree trunk
     fill_space(tree_x, tree_y, tree_z, tree_x, tree_y + 5, tree_z, WOOD);
 }
 
 void world::clear_world() {
     fill_space(0, 0, 0, WORLD_SIZE - 1, WORLD_HEIGHT - 1, WORLD_SIZE - 1, AIR);
-}
\ No newline at end of file
+
+    reset_map();
+}
+
+void world::reset_map() {
+    map_chunks = WINDOW_CHUNKS;
+    window_x = 0;
+    window_z = 0;
+
+    // No chunk has been saved on its own
+    chunk_dirty = (1 << (WINDOW_CHUNKS * WINDOW_CHUNKS)) - 1;
+}
+
+void world::unpack_unit(uint8_t unit) {
+    Block_t fill = unit_fill[unit];
+    memset(units[unit].low, (fill & 15) * 0x11, sizeof(units[unit].low));
+    memset(units[unit].high, (fill & 16) ? 0xFF : 0x00, sizeof(units[unit].high));
+    unit_fill[unit] = UNIT_PACKED;
+}
+
+Block_t *world::slice_blocks(int y) {
+    for(int x = 0; x < WINDOW_CHUNKS; x++) {
+        for(int z = 0; z < WINDOW_CHUNKS; z++) {
+            get_chunk_layer(x, z, y, &slice_buffer[(x * WORLD_SIZE + z) * CHUNK_SIZE], WORLD_SIZE);
+        }
+    }
+    return slice_buffer;
+}
+
+Block_t *world::begin_slice(int) {
+    return slice_buffer;
+}
+
+void world::end_slice(int y) {
+    for(int x = 0; x < WINDOW_CHUNKS; x++) {
+        for(int z = 0; z < WINDOW_CHUNKS; z++) {
+            put_chunk_layer(x, z, y, &slice_buffer[(x * WORLD_SIZE + z) * CHUNK_SIZE], WORLD_SIZE);
+        }
+    }
+}
+
+void world::get_chunk_layer(int chunk_x, int chunk_z, int y, Block_t *layer, int stride) {
+    uint8_t unit = unit_of(chunk_x * CHUNK_SIZE, y, chunk_z * CHUNK_SIZE);
+
+    if(unit_fill[unit] != UNIT_PACKED) {
+        for(int x = 0; x < CHUNK_SIZE; x++)
+            memset(&layer[x * stride], unit_fill[unit], CHUNK_SIZE);
+        return;
+    }
+
+    uint8_t i = 0;
+    for(int x = 0; x < CHUNK_SIZE; x++) {
+        Block_t *row = &layer[x * stride];
+        for(int z = 0; z < CHUNK_SIZE; z++)
+            row[z] = unpack_block(units[unit], i++);
+    }
+}
+
+void world::put_chunk_layer(int chunk_x, int chunk_z, int y, Block_t *layer, int stride) {
+    uint8_t unit = unit_of(chunk_x * CHUNK_SIZE, y, chunk_z * CHUNK_SIZE);
+
+    // Keep the layer as a single block if it's all the same
+    unit_fill[unit] = layer[0];
+    for(int x = 0; x < CHUNK_SIZE && unit_fill[unit] != UNIT_PACKED; x++) {
+        Block_t *row = &layer[x * stride];
+        for(int z = 0; z < CHUNK_SIZE; z++) {
+            if(row[z] != layer[0]) {
+                unit_fill[unit] = UNIT_PACKED;
+                break;
+            }
+        }
+    }
+    if(unit_fill[unit] != UNIT_PACKED) return;
+
+    uint8_t i = 0;
+    for(int x = 0; x < CHUNK_SIZE; x++) {
+        Block_t *row = &layer[x * stride];
+        for(int z = 0; z < CHUNK_SIZE; z++)
+            pack_block(units[unit], i++, row[z]);
+    }
+}
+
+// Moves a window's worth of size byte entries, indexed as [chunk X, chunk Z]
+static void shift_chunk_grid(uint8_t *grid, uint24_t size, int dx, int dz) {
+    const uint24_t row = WINDOW_CHUNKS * size;
+    if(dx > 0)
+        memmove(grid, grid + row, (WINDOW_CHUNKS - 1) * row);
+    else if(dx < 0)
+        memmove(grid + row, grid, (WINDOW_CHUNKS - 1) * row);
+
+    if(dz == 0) return;
+
+    for(uint8_t *r = grid; r < grid + WINDOW_CHUNKS * row; r += row) {
+        if(dz > 0)
+            memmove(r, r + size, (WINDOW_CHUNKS - 1) * size);
+        else
+            memmove(r + size, r, (WINDOW_CHUNKS - 1) * size);
+    }
+}
+
+void world::shift_chunks(int dx, int dz) {
+    for(int y = 0; y < WORLD_HEIGHT; y++) {
+        uint8_t unit = unit_of(0, y, 0);
+        shift_chunk_grid((uint8_t*)&units[unit], sizeof(block_unit_t), dx, dz);
+        shift_chunk_grid(&unit_fill[unit], 1, dx, dz);
+    }
+}
+
+/* The blocks along the ray through triangle i of a row, as three lines of
+*  positions (one per pair s a block can cover the triangle with). Inverting
+*  project() gives x = a[s] - y and z = c[s] - y on each, at depth
+*  row - s + (WORLD_HEIGHT - 1) - 3y, so stepping y down and s down within
+*  each y visits the blocks front to back
+*/
+typedef struct tri_ray {
+    int a[3];
+    int c[3];
+    uint8_t t[3];
+    int y_hi;
+    int y_lo;
+} tri_ray_t;
+
+static void init_tri_ray(tri_ray_t &ray, int row, int i, uint8_t max_height) {
+    ray.y_hi = -1;
+    ray.y_lo = WORLD_HEIGHT;
+
+    for(int s = 0; s < 3; s++) {
+        ray.t[s] = (i - s) & 1;
+        ray.a[s] = (i - s - ray.t[s]) / 2;
+        ray.c[s] = row - s - ray.a[s];
+
+        // The range of y this line spends inside the world
+        int hi = ray.a[s] < ray.c[s] ? ray.a[s] : ray.c[s];
+        int lo = (ray.a[s] > ray.c[s] ? ray.a[s] : ray.c[s]) - (WORLD_SIZE - 1);
+        hi = hi > WORLD_HEIGHT - 1 ? WORLD_HEIGHT - 1 : hi;
+        lo = lo < 0 ? 0 : lo;
+
+        if(hi > ray.y_hi) ray.y_hi = hi;
+        if(lo < ray.y_lo) ray.y_lo = lo;
+    }
+
+    // Nothing above the tallest column can stop the ray
+    if(ray.y_hi >= max_height) ray.y_hi = max_height - 1;
+}
+
+// The face each of the 6 triangles of a block shows
+static const uint8_t tri_faces[6] = {LEFT_FACE, RIGHT_FACE, LEFT_FACE, RIGHT_FACE, TOP_FACE, TOP_FACE};
+
+uint8_t world::trace_shadow(int row, int idx) {
+    tri_ray_t ray;
+    init_tri_ray(ray, row, idx - tri_geometry.row_offset[row], max_height);
+
+    for(int y = ray.y_hi; y >= ray.y_lo; y--) {
+        for(int s = 2; s >= 0; s--) {
+            // Position in shadow space
+            unsigned sx = ray.a[s] - y;
+            unsigned sz = ray.c[s] - y;
+            if(sx >= WORLD_SIZE || sz >= WORLD_SIZE) continue;
+
+            if(y >= column_height[sz][WORLD_SIZE - 1 - sx]) continue;
+            if(block_at(sz, y, WORLD_SIZE - 1 - sx) > WATER)
+                return row - s + (WORLD_HEIGHT - 1) - 3 * y;
+        }
+    }
+
+    return 255;
+}
+
+void world::trace_tri(int row, int idx, Block_t &tex, uint8_t &flags, uint8_t &depth) {
+    tri_ray_t ray;
+    init_tri_ray(ray, row, idx - tri_geometry.row_offset[row], max_height);
+
+    tex = AIR;
+    flags = 0;
+    depth = 255;
+    // Set once a water block has been passed, so only the frontmost one shows
+    bool water = false;
+
+    for(int y = ray.y_hi; y >= ray.y_lo; y--) {
+        for(int s = 2; s >= 0; s--) {
+            unsigned x = ray.a[s] - y;
+            unsigned z = ray.c[s] - y;
+            if(x >= WORLD_SIZE || z >= WORLD_SIZE) continue;
+            if(y >= column_height[x][z]) continue;
+
+            Block_t block = block_at(x, y, z);
+            if(block == AIR) continue;
+
+            // The depth is that of the frontmost block, water or not
+            if(depth == 255)
+                depth = row - s + (WORLD_HEIGHT - 1) - 3 * y;
+
+            if(block == WATER) {
+                if(!water) {
+                    uint8_t water_left[3];
+                    uint8_t water_right[3];
+                    compute_water(x, y, z, water_left, water_right);
+                    flags = ray.t[s] ? water_right[s] : water_left[s];
+                    water = true;
+                }
+                continue;
+            }
+
+            uint8_t face = tri_faces[s * 2 + ray.t[s]];
+            flags |= face;
+            if(face == TOP_FACE)
+                flags |= compute_top_shadow(x, y, z);
+            else if(face == LEFT_FACE)
+                flags |= compute_left_shadow(x, y, z);
+
+            tex = block;
+            return;
+        }
+    }
+}
+
+/* Fills the triangle grid and shadow map from the blocks in the world.
+*  Rather than adding every block back to front, each triangle walks its ray
+*  front to back and stops at the first solid block, giving the same result
+*  as set_block_shadow, set_water and set_block over the whole world
+*/
+void world::build_tri_grid() {
+    // The shadow map first, since the shadow flags are computed from it
+    for(int row = 0; row < ROW_CNT; row++) {
+        for(int idx = 0; idx < (int)tri_geometry.row_width[row]; idx++)
+            tri_grid_shadow[tri_geometry.rows[row] + idx] = trace_shadow(row, idx);
+    }
+
+    for(int row = 0; row < ROW_CNT; row++) {
+        for(int idx = 0; idx < (int)tri_geometry.row_width[row]; idx++) {
+            int tri_grid_idx = tri_geometry.rows[row] + idx;
+            trace_tri(row, idx, cell_tex(tri_grid_idx), cell_flags(tri_grid_idx), cell_depth(tri_grid_idx));
+        }
+    }
+
+#ifdef TRI_RUNS
+    init_tri_runs();
+#endif
+}
+
+static inline void mark_tri(uint8_t *bits, int tri_grid_idx) {
+    bits[tri_grid_idx >> 3] |= 1 << (tri_grid_idx & 7);
+}
+
+// Marks the 6 triangles of the grid a block covers
+static void mark_block_tris(uint8_t *bits, int tri_grid_idx[3]) {
+    for(uint8_t s = 0; s < 3; s++) {
+        mark_tri(bits, tri_grid_idx[s]);
+        mark_tri(bits, tri_grid_idx[s] + 1);
+    }
+}
+
+void world::begin_edit() {
+    memset(edit_tris, 0, sizeof(edit_tris));
+    memset(edit_shadows, 0, sizeof(edit_shadows));
+}
+
+void world::edit_block(int x, int y, int z, Block_t block) {
+    if(block_at(x, y, z) == block) return;
+    store_block(x, y, z, block);
+
+    int tris[3];
+    for(uint8_t s = 0; s < 3; s++)
+        tris[s] = project(x, y, z, s);
+    mark_block_tris(edit_tris, tris);
+
+    uint8_t sx, sy, sz;
+    to_shadow_space(x, y, z, sx, sy, sz);
+    for(uint8_t s = 0; s < 3; s++)
+        tris[s] = project(sx, sy, sz, s);
+    mark_block_tris(edit_shadows, tris);
+
+    // The water blocks whose surface looks at this one
+    for(uint8_t i = 0; i < 4; i++) {
+        unsigned nx = x + near_water[i][0];
+        unsigned ny = y + near_water[i][1];
+        unsigned nz = z + near_water[i][2];
+        if(nx >= WORLD_SIZE || ny >= WORLD_HEIGHT || nz >= WORLD_SIZE) continue;
+        if(block_at(nx, ny, nz) != WATER) continue;
+
+        for(uint8_t s = 0; s < 3; s++)
+            tris[s] = project(nx, ny, nz, s);
+        mark_block_tris(edit_tris, tris);
+    }
+}
+
+/* Finds the next triangle set in a batch's bits at or after tri_grid_idx,
+*  along with the row it's in. Skips 8 triangles at a time where none are set,
+*  since a small batch leaves almost every byte empty. Returns TRI_CNT once
+*  there are none left
+*/
+static int next_marked(const uint8_t *bits, int tri_grid_idx, int &row) {
+    for(; tri_grid_idx < TRI_CNT; tri_grid_idx++) {
+        if(!bits[tri_grid_idx >> 3]) {
+            tri_grid_idx |= 7;
+            continue;
+        }
+        if(bits[tri_grid_idx >> 3] & (1 << (tri_grid_idx & 7))) break;
+    }
+    while(row < ROW_CNT - 1 && tri_grid_idx >= (int)tri_geometry.rows[row + 1])
+        row++;
+    return tri_grid_idx;
+}
+
+void world::commit_edit() {
+    // The shadow map first, since the shadow flags are computed from it
+    int row = 0;
+    for(int tri_grid_idx = next_marked(edit_shadows, 0, row); tri_grid_idx < TRI_CNT;
+            tri_grid_idx = next_marked(edit_shadows, tri_grid_idx + 1, row)) {
+        int idx = tri_grid_idx - tri_geometry.rows[row];
+
+        uint8_t old_depth = tri_grid_shadow[tri_grid_idx];
+        uint8_t new_depth = trace_shadow(row, idx);
+        if(new_depth == old_depth) continue;
+        tri_grid_shadow[tri_grid_idx] = new_depth;
+
+        // Only the blocks between the old and new depths along this ray
+        // can have gone into or out of its shadow
+        uint8_t depth = old_depth < new_depth ? old_depth : new_depth;
+        uint8_t last = old_depth < new_depth ? new_depth : old_depth;
+        for(; depth <= last && depth != 255; depth++) {
+            uint8_t sx, sy, sz;
+            unproject(row, idx, depth, sx, sy, sz);
+            if(sx >= WORLD_SIZE || sy >= WORLD_HEIGHT || sz >= WORLD_SIZE) break;
+
+            uint8_t x, y, z;
+            from_shadow_space(sx, sy, sz, x, y, z);
+            if(block_at(x, y, z) == AIR) continue;
+
+            int tris[3];
+            for(uint8_t s = 0; s < 3; s++)
+                tris[s] = project(x, y, z, s);
+            mark_block_tris(edit_tris, tris);
+        }
+    }
+
+    row = 0;
+    for(int tri_grid_idx = next_marked(edit_tris, 0, row); tri_grid_idx < TRI_CNT;
+            tri_grid_idx = next_marked(edit_tris, tri_grid_idx + 1, row)) {
+        Block_t tex;
+        uint8_t flags, depth;
+        trace_tri(row, tri_grid_idx - tri_geometry.rows[row], tex, flags, depth);
+
+        bool changed = cell_tex(tri_grid_idx) != tex || cell_flags(tri_grid_idx) != flags;
+        cell_tex(tri_grid_idx) = tex;
+        cell_flags(tri_grid_idx) = flags;
+        cell_depth(tri_grid_idx) = depth;
+        if(changed)
+            tri_changed(tri_grid_idx);
+    }
+}
@@ -8,6 +8,24 @@
 #define WORLD_SIZE 48
 #define WORLD_HEIGHT 16
 
+// Blocks in one horizontal Y slice of the world
+#define SLICE_SIZE (WORLD_SIZE * WORLD_SIZE)
+
+// -------- Map Chunks --------
+// The world in RAM is a window onto a bigger map, which is split into
+// columns of CHUNK_SIZE x WORLD_HEIGHT x CHUNK_SIZE blocks. Chunks outside the
+// window are kept in archive and paged in as the player moves around
+
+#define CHUNK_SIZE 16
+#define CHUNK_AREA (CHUNK_SIZE * CHUNK_SIZE)
+// Chunks across the window, and so across the smallest map
+#define WINDOW_CHUNKS (WORLD_SIZE / CHUNK_SIZE)
+#define MAX_MAP_CHUNKS 9
+
+static_assert(WORLD_SIZE % CHUNK_SIZE == 0, "The window must be a whole number of chunks");
+static_assert(MAX_MAP_CHUNKS % WINDOW_CHUNKS == 0, "Maps are generated a window at a time");
+static_assert(WINDOW_CHUNKS * WINDOW_CHUNKS <= 16, "Each chunk in the window needs a dirty bit");
+
 // Flags for the face configurations of each triangle
 #define LEFT_FACE 0
 #define RIGHT_FACE 1
@@ -26,6 +44,61 @@
 #define TRI_CNT (((WORLD_SIZE * WORLD_SIZE) + (2 * WORLD_SIZE * WORLD_HEIGHT)) * 2)
 #define ROW_CNT (WORLD_SIZE + WORLD_SIZE + WORLD_HEIGHT + WORLD_HEIGHT - 1)
 
+/* The layout of the rows of the triangle grid for a world of the given size.
+*  The grid is a hexagon, so the rows widen by a pair of triangles for each of
+*  the first SIZE rows, keep their width for the next 2 * HEIGHT - 1, then
+*  narrow again. The compiler works the tables out, so they're kept with the
+*  program instead of taking up SafeRAM
+*/
+template<int SIZE, int HEIGHT>
+struct grid_layout {
+    static constexpr int ROWS = SIZE + SIZE + HEIGHT + HEIGHT - 1;
+
+    // Indices into the triangle grid for the start of each row segment
+    uint24_t rows[ROWS];
+
+    // Adjustment offset because rows change length at different rates across the hexagon
+    int24_t row_offset[ROWS];
+
+    // Pixel offset from the center for each row's starting point
+    int24_t row_px_offset[ROWS];
+
+    uint24_t row_width[ROWS];
+
+    constexpr grid_layout() : rows(), row_offset(), row_px_offset(), row_width() {
+        // The starting index (in the overall array) of this row
+        int idx = 0;
+        // The width in triangles of this row
+        int width = 0;
+        for(int row = 0; row < ROWS; row++) {
+            // Width increases with each row of the bottom diamond
+            if(row < SIZE)
+                width += 2;
+            // Store the start index of this row, and compute the index for the next row
+            rows[row] = idx;
+            idx += width;
+            // Compute the pixel offset of the leftmost trangle based on the width of the row
+            row_px_offset[row] = (width * 8) - 16;
+            // Compute the trigrid offset based on how this row width deviates from the width
+            // of an infinite trigrid
+            row_offset[row] = (width - (2 * row + 2)) / 2;
+            row_width[row] = width;
+            // And decreases after each row of the upper diamond
+            if(row >= SIZE + HEIGHT + HEIGHT - 1)
+                width -= 2;
+        }
+    }
+};
+
+typedef grid_layout<WORLD_SIZE, WORLD_HEIGHT> grid_layout_t;
+
+static_assert(grid_layout_t::ROWS == ROW_CNT, "Every row of the triangle grid needs a layout");
+static_assert(grid_layout_t().rows[ROW_CNT - 1] + grid_layout_t().row_width[ROW_CNT - 1] == TRI_CNT,
+              "The rows of the triangle grid must cover it exactly");
+
+// The layout of this world's triangle grid (see world.cpp)
+extern const grid_layout_t tri_geometry;
+
 inline uint8_t project_view_depth(uint8_t x, uint8_t y, uint8_t z) {
     return x + z + (WORLD_HEIGHT - 1 - y);
 }
@@ -46,31 +119,119 @@ inline void from_shadow_space(uint8_t x, uint8_t y, uint8_t z, uint8_t &sx, uint
     sz = WORLD_SIZE - 1 - x;
 }
 
-typedef struct world {
-    // 3D array of the world, indexed as [Y, X, Z]
-    Block_t blocks[WORLD_HEIGHT][WORLD_SIZE][WORLD_SIZE];
+#ifdef TRI_CELLS
+// One triangle of the grid, so drawing or editing it reads one place rather
+// than three arrays
+typedef struct tri_cell {
+    // The associated texture
+    uint8_t tex;
+    // The flags determining drawing information
+    uint8_t flags;
+    // The projected depth of its block from the view of the camera
+    uint8_t depth;
+} tri_cell_t;
+#endif
+
+// -------- Packed Blocks --------
+// Every block fits in 5 bits, so each layer of a chunk in the window is a
+// unit of CHUNK_AREA blocks stored in 5/8 of the space: the low 4 bits two
+// to a byte and the top bit eight to a byte, so no block straddles a byte.
+// A unit that's all one block (the air above the terrain, the bedrock below
+// it) is just that block, and isn't unpacked until a different block is
+// stored in it. The space saved goes to the triangle cache
+
+#define UNIT_CNT (WORLD_HEIGHT * WINDOW_CHUNKS * WINDOW_CHUNKS)
+// Stored as a unit's fill when its blocks are packed
+#define UNIT_PACKED 0xFF
+
+static_assert(GOLD < 32, "Every block has to fit in 5 bits");
+static_assert(UNIT_CNT < UNIT_PACKED, "Units are indexed by a byte");
+
+typedef struct block_unit {
+    // The low 4 bits of each block, even blocks in the low nibble
+    uint8_t low[CHUNK_AREA / 2];
+    // The top bit of each block
+    uint8_t high[CHUNK_AREA / 8];
+} block_unit_t;
 
+typedef struct world {
+    // The blocks of each chunk layer in the window, indexed as
+    // [Y, chunk X, chunk Z]. Only read or write them through block_at and
+    // store_block, or a slice or layer at a time through the functions below
+    block_unit_t units[UNIT_CNT];
+
+    // The block filling each unit, or UNIT_PACKED if it holds different ones
+    uint8_t unit_fill[UNIT_CNT];
+
+    // Where the blocks of a slice are unpacked to, so they can be handled whole
+    Block_t slice_buffer[SLICE_SIZE];
+
+    // One bit per Y slice, set when a block in it changes so saving only has
+    // to rewrite the slices modified since the last load or save
+    uint8_t slice_dirty[(WORLD_HEIGHT + 7) / 8];
+
+    // Chunks across the whole map, and the chunk the window starts at
+    uint8_t map_chunks;
+    uint8_t window_x;
+    uint8_t window_z;
+
+    // One bit per chunk in the window, indexed as [X, Z], set when it no
+    // longer matches its variable in archive so paging it out rewrites it
+    uint16_t chunk_dirty;
+
+#ifdef TRI_CELLS
+    // Everything about each triangle, kept together
+    tri_cell_t tri_grid[TRI_CNT];
+#else
     // The associated texture for each triangle
     uint8_t tri_grid_tex[TRI_CNT];
     // The flags determining drawing information for each triangle
     uint8_t tri_grid_flags[TRI_CNT];
     // The projected depth of each block from the view of the camera
     uint8_t tri_grid_depth[TRI_CNT];
+#endif
+
+    // The projected depth of each triangle from the view of the sun
+    uint8_t tri_grid_shadow[TRI_CNT];
+
+    // One bit per triangle, set when its texture or flags change so only
+    // those triangles need to be repainted
+    uint8_t tri_grid_dirty[(TRI_CNT + 7) / 8];
+
+#ifdef TRI_RUNS
+    // One bit per triangle, set when it has the same texture and flags as the
+    // triangle two along (the same half of the next pair). Lets the renderer
+    // find runs of identical triangle pairs without comparing them
+    uint8_t tri_grid_run[(TRI_CNT + 7) / 8];
+#endif
+
+    // How far up each column of the window reaches, indexed as [X, Z]: one
+    // more than its highest block that isn't air, or 0 if it has none. A ray
+    // doesn't have to read the block at any position at or above the height
+    // of its column
+    uint8_t column_height[WORLD_SIZE][WORLD_SIZE];
+    // At least as high as every column_height. Rays start below it
+    uint8_t max_height;
+
+    // The triangles of the grid and the shadow map the current batch of
+    // edits has to retrace, one bit per triangle
+    uint8_t edit_tris[(TRI_CNT + 7) / 8];
+    uint8_t edit_shadows[(TRI_CNT + 7) / 8];
+
+    /* Clears the trigrid to empty sky */
+    void init_tri_grid();
 
-    // Indices into the above array for the start of each row segment
-    uint24_t tri_grid_rows[ROW_CNT];
-
-    // Adjustment offset because rows change length at different rates across the hexagon
-    int24_t tri_grid_row_offset[ROW_CNT];
-
-    // Pixel offset from the center for each row's starting point
-    int24_t tri_grid_row_px_offset[ROW_CNT];
-
-    uint24_t tri_grid_row_width[ROW_CNT];
+    /* Fills the triangle grid and shadow map from the blocks in the world, walking
+    * each triangle's ray front to back until it reaches a solid block
+    */
+    void build_tri_grid();
 
+    // Walks the ray of shadow map triangle (row, idx) and returns the light
+    // depth of the first solid block, or 255 if there is none
+    uint8_t trace_shadow(int row, int idx);
 
-    /* Populates the LUTs for indexing into the trigrid */
-    void init_tri_grid();
+    // Walks the ray of triangle (row, idx) and works out what it shows
+    void trace_tri(int row, int idx, Block_t &tex, uint8_t &flags, uint8_t &depth);
 
     /* Sweeps through blocks in the world starting from (x, y, z) and apply steps of
     * (dx, dy, dz) to offset the search. Return true if we find a solid block, false
@@ -99,12 +260,193 @@ typedef struct world {
 
     void unproject(int row, int idx, int depth, uint8_t &x, uint8_t &y, uint8_t &z);
 
+    void mark_dirty(int tri_grid_idx) {
+        tri_grid_dirty[tri_grid_idx >> 3] |= 1 << (tri_grid_idx & 7);
+    }
+
+    // Marks all 6 triangles a block projects to, whether or not it is visible
+    void mark_block_dirty(int x, int y, int z);
+
+    void clear_dirty() {
+        memset(tri_grid_dirty, 0, sizeof(tri_grid_dirty));
+    }
+
+    // The texture, flags and depth of a triangle, wherever the layout keeps them
+#ifdef TRI_CELLS
+    uint8_t &cell_tex(int tri_grid_idx) {
+        return tri_grid[tri_grid_idx].tex;
+    }
+
+    uint8_t &cell_flags(int tri_grid_idx) {
+        return tri_grid[tri_grid_idx].flags;
+    }
+
+    uint8_t &cell_depth(int tri_grid_idx) {
+        return tri_grid[tri_grid_idx].depth;
+    }
+#else
+    uint8_t &cell_tex(int tri_grid_idx) {
+        return tri_grid_tex[tri_grid_idx];
+    }
+
+    uint8_t &cell_flags(int tri_grid_idx) {
+        return tri_grid_flags[tri_grid_idx];
+    }
+
+    uint8_t &cell_depth(int tri_grid_idx) {
+        return tri_grid_depth[tri_grid_idx];
+    }
+#endif
+
+#ifdef TRI_RUNS
+    bool tri_run(int tri_grid_idx) {
+        return tri_grid_run[tri_grid_idx >> 3] & (1 << (tri_grid_idx & 7));
+    }
+
+    // Recomputes the run bit of a single triangle
+    void update_run(int tri_grid_idx);
+
+    // Recomputes every run bit from the current grid
+    void init_tri_runs();
+#endif
+
+    static uint8_t unit_of(int x, int y, int z) {
+        return (y * WINDOW_CHUNKS + (unsigned)x / CHUNK_SIZE) * WINDOW_CHUNKS + (unsigned)z / CHUNK_SIZE;
+    }
+
+    // Index of block (x, z) within its unit
+    static uint8_t unit_offset(int x, int z) {
+        return ((unsigned)x % CHUNK_SIZE) * CHUNK_SIZE + (unsigned)z % CHUNK_SIZE;
+    }
+
+    static Block_t unpack_block(block_unit_t &unit, uint8_t i) {
+        uint8_t low = unit.low[i >> 1];
+        if(i & 1) low >>= 4;
+        return (low & 15) | ((unit.high[i >> 3] >> (i & 7) & 1) << 4);
+    }
+
+    static void pack_block(block_unit_t &unit, uint8_t i, Block_t block) {
+        uint8_t &low = unit.low[i >> 1];
+        if(i & 1)
+            low = (low & 0x0F) | ((block & 15) << 4);
+        else
+            low = (low & 0xF0) | (block & 15);
+
+        uint8_t bit = 1 << (i & 7);
+        if(block & 16)
+            unit.high[i >> 3] |= bit;
+        else
+            unit.high[i >> 3] &= ~bit;
+    }
+
+    Block_t block_at(int x, int y, int z) {
+        uint8_t unit = unit_of(x, y, z);
+        if(unit_fill[unit] != UNIT_PACKED) return unit_fill[unit];
+        return unpack_block(units[unit], unit_offset(x, z));
+    }
+
+    // Changes a block without touching the triangle grid
+    void store_block(int x, int y, int z, Block_t block) {
+        uint8_t unit = unit_of(x, y, z);
+        uint8_t i = unit_offset(x, z);
+
+        if(unit_fill[unit] == block) return;
+        if(unit_fill[unit] != UNIT_PACKED)
+            unpack_unit(unit);
+        else if(unpack_block(units[unit], i) == block)
+            return;
+
+        pack_block(units[unit], i, block);
+        mark_slice_dirty(y);
+        mark_chunk_dirty(x, z);
+        update_height(x, y, z, block);
+    }
+
+    // Gives a unit that's all one block room for different ones
+    void unpack_unit(uint8_t unit);
+
+    // Updates the height of a column after one of its blocks changed
+    void update_height(int x, int y, int z, Block_t block);
+
+    // Works out the height of a column from scratch
+    void build_column(int x, int z);
+
+    // Works out the height of every column. Must be called after blocks are
+    // changed a slice or layer at a time, which doesn't keep them up to date
+    void build_columns();
+
+    // Returns the blocks of a slice as SLICE_SIZE bytes indexed as [X, Z].
+    // They're unpacked into slice_buffer, so they only last until the next
+    // call
+    Block_t *slice_blocks(int y);
+
+    // Returns somewhere to write a whole slice of blocks, indexed as [X, Z],
+    // which have to be stored with end_slice. Doesn't mark the slice dirty
+    Block_t *begin_slice(int y);
+    void end_slice(int y);
+
+    // Copies one layer of window chunk (chunk_x, chunk_z) to or from rows of
+    // CHUNK_SIZE blocks, stride blocks apart. Doesn't mark anything dirty
+    void get_chunk_layer(int chunk_x, int chunk_z, int y, Block_t *layer, int stride);
+    void put_chunk_layer(int chunk_x, int chunk_z, int y, Block_t *layer, int stride);
+
+    // Moves the blocks in the window dx, dz chunks (each -1, 0 or 1) towards
+    // the start, leaving the chunks uncovered at the other end to be filled in
+    void shift_chunks(int dx, int dz);
+
+    void mark_slice_dirty(int y) {
+        slice_dirty[y >> 3] |= 1 << (y & 7);
+    }
+
+    bool is_slice_dirty(int y) {
+        return slice_dirty[y >> 3] & (1 << (y & 7));
+    }
+
+    void clean_slice(int y) {
+        slice_dirty[y >> 3] &= ~(1 << (y & 7));
+    }
+
+    bool any_slice_dirty() {
+        for(uint8_t i = 0; i < sizeof(slice_dirty); i++)
+            if(slice_dirty[i]) return true;
+        return false;
+    }
+
+    void clear_slice_dirty() {
+        memset(slice_dirty, 0, sizeof(slice_dirty));
+    }
+
+    // The dirty bit of the window chunk holding block (x, z)
+    void mark_chunk_dirty(int x, int z) {
+        chunk_dirty |= 1 << (((unsigned)x / CHUNK_SIZE) * WINDOW_CHUNKS + (unsigned)z / CHUNK_SIZE);
+    }
+
+    bool is_chunk_dirty(int chunk_x, int chunk_z) {
+        return chunk_dirty & (1 << (chunk_x * WINDOW_CHUNKS + chunk_z));
+    }
+
+    bool is_small_map() {
+        return map_chunks == WINDOW_CHUNKS;
+    }
+
+    // Makes the window the whole of a map no bigger than it
+    void reset_map();
+
+    // Must be called after a triangle's texture or flags are changed
+    void tri_changed(int tri_grid_idx);
+
     void set_block(int x, int y, int z, Block_t block);
 
     void refresh_shadows(int x, int y, int z);
 
+    // Works out which water mask pattern should be used on each of the triangles a water block covers
+    void compute_water(int x, int y, int z, uint8_t water_left[3], uint8_t water_right[3]);
+
     void set_water(int x, int y, int z);
 
+    // Recomputes the water masks of the water blocks whose surface depends on the given position
+    void refresh_near_water(int x, int y, int z);
+
     void set_block_shadow(int x, int y, int z);
 
     void place_block(int x, int y, int z, Block_t block);
@@ -115,6 +457,21 @@ typedef struct world {
 
     void remove_block(int x, int y, int z);
 
+    /* Starts a batch of edits. Blocks changed with edit_block don't touch the
+    *  triangle grid or shadow map until commit_edit, which retraces each
+    *  affected triangle once however many of the blocks cover it. Meant for
+    *  changing many blocks at once, where a place_block or remove_block each
+    *  would redo the same triangles over and over
+    */
+    void begin_edit();
+
+    // Changes a block as part of the current batch
+    void edit_block(int x, int y, int z, Block_t block);
+
+    // Brings the triangle grid and shadow map up to date with the batch,
+    // marking the triangles that changed as dirty for one redraw
+    void commit_edit();
+
     // Inclusively fills the space within the provided bounds with the specified block
     void fill_space(int x0, int y0, int z0, int x1, int y1, int z1, Block_t block);
 
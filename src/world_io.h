@@ -4,117 +4,771 @@
 #include "player.h"
 #include "ui.h"
 
+// Seconds of play between background saves of a world with unsaved changes
+#define AUTOSAVE_SECONDS 120
+
+// -------- Slice Codec --------
+// Each horizontal slice of blocks (len of them, SLICE_SIZE for a whole world
+// slice or CHUNK_AREA for one layer of a chunk) is run length encoded. A run
+// of up to 7 of the same block is a single byte holding the length in the
+// top 3 bits and the block in the rest, and longer runs add a byte of length
+// after it. Any value too big for those bits is escaped and follows in its
+// own byte. A slice that doesn't shrink is stored raw instead, and since raw
+// slices (including those from older saves) are exactly len bytes long the
+// two are told apart by size alone
+
+#define SLICE_BLOCK_BITS 5
+#define SLICE_BLOCK_MASK ((1 << SLICE_BLOCK_BITS) - 1)
+// Stored in place of a block to mean the value is in the next byte
+#define SLICE_ESCAPE SLICE_BLOCK_MASK
+// The longest run stored in a single byte, whose length code is one less
+#define SLICE_SHORT_RUN 7
+// Longer runs use this length code, with the rest of the length after it
+#define SLICE_LONG_CODE 7
+#define SLICE_LONG_RUN (SLICE_SHORT_RUN + 1 + 255)
+
+static_assert(GOLD < SLICE_ESCAPE, "Every block should fit in the low bits of a run");
+
+// Returns the length of the run of identical blocks starting at i, up to the
+// longest run one code can hold
+uint24_t slice_run(Block_t *slice, uint24_t len, uint24_t i) {
+    uint24_t n = 1;
+    while(i + n < len && n < SLICE_LONG_RUN && slice[i + n] == slice[i])
+        n++;
+    return n;
+}
+
+// Returns how many bytes a slice takes to store run length encoded
+uint24_t encoded_slice_size(Block_t *slice, uint24_t len) {
+    uint24_t size = 0;
+    for(uint24_t i = 0; i < len; ) {
+        uint24_t n = slice_run(slice, len, i);
+        size += 1 + (n > SLICE_SHORT_RUN) + (slice[i] >= SLICE_ESCAPE);
+        i += n;
+    }
+    return size;
+}
+
+// Writes a slice to a variable, encoded if that makes it smaller. Returns
+// false if the variable ran out of room
+bool write_slice(Block_t *slice, uint24_t len, ti_var_t var) {
+    if(encoded_slice_size(slice, len) >= len)
+        return ti_Write(slice, len, 1, var) == 1;
+
+    for(uint24_t i = 0; i < len; ) {
+        uint24_t n = slice_run(slice, len, i);
+        uint8_t run[3];
+        uint8_t run_len = 1;
+
+        uint8_t code = (n > SLICE_SHORT_RUN) ? SLICE_LONG_CODE : n - 1;
+
+        if(slice[i] >= SLICE_ESCAPE) {
+            run[0] = (code << SLICE_BLOCK_BITS) | SLICE_ESCAPE;
+            run[run_len++] = slice[i];
+        }
+        else {
+            run[0] = (code << SLICE_BLOCK_BITS) | slice[i];
+        }
+
+        if(n > SLICE_SHORT_RUN)
+            run[run_len++] = n - SLICE_SHORT_RUN - 1;
+
+        if(ti_Write(run, run_len, 1, var) != 1) return false;
+        i += n;
+    }
+    return true;
+}
+
+// Reads a slice stored by write_slice in the next size bytes of a variable,
+// decoding it straight into place. Returns false if the data is cut short or
+// its runs overflow the slice
+bool read_slice(Block_t *slice, uint24_t len, ti_var_t var, uint24_t size) {
+    if(size == len)
+        return ti_Read(slice, len, 1, var) == 1;
+
+    for(uint24_t i = 0; i < len; ) {
+        int c = ti_GetC(var);
+        if(c == EOF) return false;
+
+        int block = c & SLICE_BLOCK_MASK;
+        if(block == SLICE_ESCAPE) {
+            block = ti_GetC(var);
+            if(block == EOF) return false;
+        }
+
+        uint24_t n = (c >> SLICE_BLOCK_BITS) + 1;
+        if(n > SLICE_SHORT_RUN) {
+            int extra = ti_GetC(var);
+            if(extra == EOF) return false;
+            n = SLICE_SHORT_RUN + 1 + extra;
+        }
+
+        if(i + n > len) return false;
+
+        memset(&slice[i], block, n);
+        i += n;
+    }
+    return true;
+}
+
+// -------- World Files --------
+// A world is a header variable (WORLDA for world A) holding:
+//   [3: "BLK"][1: version][1: WORLD_SIZE][1: WORLD_HEIGHT]
+//   [1: player x][1: player y][1: player z][1: current block]
+//   [3: scroll x][3: scroll y]
+//   [1: map chunks][1: window x][1: window z][2: chunk dirty bits]
+// and one variable per slice of the window (WORLDA00 - WORLDA15), each
+// stored by write_slice, so a save only has to rewrite the slices that
+// changed. The rest of the map is in chunk variables.
+//
+// Older saves had the same slice variables, but their header was only the
+// 10 bytes of player details. They still load, and get the full header the
+// next time they're saved. Versions 1 and 2 kept the slices in the header
+// variable itself, and are no longer loaded
+
+#define WORLD_MAGIC "BLK"
+#define WORLD_VERSION 3
+#define WORLD_HEADER_SIZE 21
+#define LEGACY_HEADER_SIZE 10
+
+void slice_name(char *name, uint8_t world_id, uint8_t y) {
+    memcpy(name, "WORLDA", 6);
+    name[5] = 'A' + world_id;
+    name[6] = '0' + (y / 10);
+    name[7] = '0' + (y % 10);
+    name[8] = 0;
+}
+
+// Swaps a finished temporary variable in for the one called name
+void replace_var(const char *temp_name, const char *name) {
+    ti_Delete(name);
+    ti_Rename(temp_name, name);
+}
+
+// Archives a variable if it's still in RAM
+void archive_var(const char *name) {
+    ti_var_t var = ti_Open(name, "r");
+    if (var == 0) return;
+
+    if(!ti_IsArchived(var))
+        ti_SetArchiveStatus(true, var);
+    ti_Close(var);
+}
+
+// Writes the player details shared by every layout
+void write_player(player_t &player, ti_var_t var) {
+    ti_PutC((uint8_t)player.x, var);
+    ti_PutC((uint8_t)player.y, var);
+    ti_PutC((uint8_t)player.z, var);
+    ti_PutC((uint8_t)player.current_block, var);
+
+    ti_PutC((uint8_t)((scroll_x >> 16) & 0xFF), var);
+    ti_PutC((uint8_t)((scroll_x >>  8) & 0xFF), var);
+    ti_PutC((uint8_t)((scroll_x >>  0) & 0xFF), var);
+
+    ti_PutC((uint8_t)((scroll_y >> 16) & 0xFF), var);
+    ti_PutC((uint8_t)((scroll_y >>  8) & 0xFF), var);
+    ti_PutC((uint8_t)((scroll_y >>  0) & 0xFF), var);
+}
+
+// Reads the player details shared by every layout
+void read_player(player_t &player, ti_var_t var) {
+    player.x = (int24_t)ti_GetC(var);
+    player.y = (int24_t)ti_GetC(var);
+    player.z = (int24_t)ti_GetC(var);
+
+    player.current_block = ti_GetC(var);
+
+    scroll_x = 0;
+    scroll_x += ti_GetC(var);
+    scroll_x <<= 8; 
+    scroll_x += ti_GetC(var);
+    scroll_x <<= 8; 
+    scroll_x += ti_GetC(var);
+
+    scroll_y = 0;
+    scroll_y += ti_GetC(var);
+    scroll_y <<= 8; 
+    scroll_y += ti_GetC(var);
+    scroll_y <<= 8; 
+    scroll_y += ti_GetC(var);
+}
+
+// Writes where the window is on the map
+void write_map(world_t &world, ti_var_t var) {
+    ti_PutC(world.map_chunks, var);
+    ti_PutC(world.window_x, var);
+    ti_PutC(world.window_z, var);
+    ti_Write(&world.chunk_dirty, 2, 1, var);
+}
+
+// Reads where the window is on the map. Returns false if it's off the map
+bool read_map(world_t &world, ti_var_t var) {
+    world.map_chunks = ti_GetC(var);
+    world.window_x = ti_GetC(var);
+    world.window_z = ti_GetC(var);
+    if(ti_Read(&world.chunk_dirty, 2, 1, var) != 1) return false;
+
+    return world.map_chunks >= WINDOW_CHUNKS && world.map_chunks <= MAX_MAP_CHUNKS &&
+           world.window_x + WINDOW_CHUNKS <= world.map_chunks &&
+           world.window_z + WINDOW_CHUNKS <= world.map_chunks;
+}
+
+// Writes the header variable of a world, leaving it in RAM. Like the slices
+// it's written under a temporary name first. Returns false if it couldn't be
+// saved
+bool write_header(uint8_t world_id, world_t &world, player_t &player) {
+    char temp_name[8] = "WORLDAN";
+    temp_name[5] = 'A' + world_id;
+
+    ti_var_t var = ti_Open(temp_name, "w+");
+    if (var == 0) return false;
+
+    ti_Write(WORLD_MAGIC, 3, 1, var);
+    ti_PutC(WORLD_VERSION, var);
+    ti_PutC(WORLD_SIZE, var);
+    ti_PutC(WORLD_HEIGHT, var);
+    write_player(player, var);
+    write_map(world, var);
+
+    bool written = ti_GetSize(var) == WORLD_HEADER_SIZE;
+    ti_Close(var);
+
+    if(!written) {
+        ti_Delete(temp_name);
+        return false;
+    }
 
-// Saves a world and player position details to a set of files.
-// (world_id should be 1-5 though that limit is only imposed by the UI)
-void save(uint8_t world_id, world_t &world, player_t &player) {
     char filename[7] = "WORLDA";
     filename[5] = 'A' + world_id;
+    replace_var(temp_name, filename);
+    return true;
+}
+
+// Writes slice y of a world to its variable, leaving it in RAM. It's written
+// under a temporary name first so running out of memory part way through
+// can't lose the old copy. Returns false if it couldn't be saved
+bool write_slice_var(uint8_t world_id, world_t &world, uint8_t y) {
+    char temp_name[8] = "WORLDAN";
+    temp_name[5] = 'A' + world_id;
 
-    // Save player position
-    {
-        ti_var_t var = ti_Open(filename, "w+");
-        if (var == 0) return;
+    ti_var_t var = ti_Open(temp_name, "w+");
+    if (var == 0) return false;
 
-        ti_PutC((uint8_t)player.x, var);
-        ti_PutC((uint8_t)player.y, var);
-        ti_PutC((uint8_t)player.z, var);
-        ti_PutC((uint8_t)player.current_block, var);
+    bool written = write_slice(world.slice_blocks(y), SLICE_SIZE, var);
+    ti_Close(var);
 
-        ti_PutC((uint8_t)((scroll_x >> 16) & 0xFF), var);
-        ti_PutC((uint8_t)((scroll_x >>  8) & 0xFF), var);
-        ti_PutC((uint8_t)((scroll_x >>  0) & 0xFF), var);
+    if(!written) {
+        ti_Delete(temp_name);
+        return false;
+    }
+
+    char name[9];
+    slice_name(name, world_id, y);
+    replace_var(temp_name, name);
+    return true;
+}
 
-        ti_PutC((uint8_t)((scroll_y >> 16) & 0xFF), var);
-        ti_PutC((uint8_t)((scroll_y >>  8) & 0xFF), var);
-        ti_PutC((uint8_t)((scroll_y >>  0) & 0xFF), var);
+// Returns how many chunks across the map of an open world file is
+uint8_t saved_map_chunks(ti_var_t var) {
+    char magic[3];
+    if(ti_Read(magic, 3, 1, var) != 1 || memcmp(magic, WORLD_MAGIC, 3) != 0 || ti_GetC(var) != WORLD_VERSION)
+        return WINDOW_CHUNKS;
 
-        ti_SetArchiveStatus(true, var);
+    ti_Seek(WORLD_HEADER_SIZE - 5, SEEK_SET, var);
+    return ti_GetC(var);
+}
+
+// Reads the slices of a world from their variables
+bool read_slice_vars(uint8_t world_id, world_t &world) {
+    char name[9];
+
+    for(uint8_t i = 0; i < WORLD_HEIGHT; i++) {
+        slice_name(name, world_id, i);
+
+        ti_var_t var = ti_Open(name, "r");
+        if (var == 0) return false;
+
+        bool read = read_slice(world.begin_slice(i), SLICE_SIZE, var, ti_GetSize(var));
+        world.end_slice(i);
 
         ti_Close(var);
+
+        if(!read) return false;
     }
+    return true;
+}
 
+// Deletes the slice variables of a world
+void erase_slices(uint8_t world_id) {
+    char name[9];
 
+    for(uint8_t i = 0; i < WORLD_HEIGHT; i++) {
+        slice_name(name, world_id, i);
+        ti_Delete(name);
+    }
+}
 
-    char out_name[9] = "WORLDA00";
-    out_name[5] = 'A' + world_id;
+// -------- Map Chunks --------
+// Each chunk of the map has its own variable, named after the world and the
+// chunk's position on the map, so chunk (1, 2) of world A is WORLDABC. It
+// holds a table of WORLD_HEIGHT + 1 little endian 16 bit offsets from the
+// start of the variable, one to each layer plus one to the end, followed by
+// each layer of the chunk encoded as a slice of CHUNK_AREA blocks. While a
+// chunk is in the window the slice variables have the latest copy of it, and
+// its variable is only rewritten when it's paged out with changes
+
+// The player is kept at least this far from the edge of the window, so
+// there's always map in view around them
+#define PAGE_MARGIN (CHUNK_SIZE / 2)
+
+void chunk_name(char *name, uint8_t world_id, uint8_t map_x, uint8_t map_z) {
+    memcpy(name, "WORLDA", 6);
+    name[5] = 'A' + world_id;
+    name[6] = 'A' + map_x;
+    name[7] = 'A' + map_z;
+    name[8] = 0;
+}
 
-    // To save RAM, worlds are stored and loaded one horizontal slice
-    // at a time
-    for(uint8_t i = 0; i < WORLD_HEIGHT; i++) {
-        fill_progress_bar(i, WORLD_HEIGHT);
+bool in_window(int chunk) {
+    return chunk >= 0 && chunk < WINDOW_CHUNKS;
+}
 
-        // Set the digit counter to the world level
-        out_name[6] = '0' + (i / 10);
-        out_name[7] = '0' + (i % 10);
+// Saves window chunk (chunk_x, chunk_z) to its variable and archives it. Like
+// the slices it's written under a temporary name first. Background saves,
+// made during play, leave it in RAM for the next full save to archive.
+// Returns false if it couldn't be saved
+bool write_chunk(uint8_t world_id, world_t &world, uint8_t chunk_x, uint8_t chunk_z, bool background = false) {
+    char temp_name[8] = "WORLDAN";
+    temp_name[5] = 'A' + world_id;
+
+    ti_var_t var = ti_Open(temp_name, "w+");
+    if (var == 0) return false;
+
+    uint16_t table[WORLD_HEIGHT + 1];
+    memset(table, 0, sizeof(table));
+    bool written = ti_Write(table, sizeof(table), 1, var) == 1;
+
+    Block_t layer[CHUNK_AREA];
+    for(uint8_t y = 0; y < WORLD_HEIGHT && written; y++) {
+        table[y] = ti_Tell(var);
+        world.get_chunk_layer(chunk_x, chunk_z, y, layer, CHUNK_SIZE);
+        written = write_slice(layer, CHUNK_AREA, var);
+    }
+    table[WORLD_HEIGHT] = ti_Tell(var);
 
-        /* Open a new variable; deleting it if it already exists */
-        ti_var_t var = ti_Open(out_name, "w+");
-        if (var == 0) return;
+    if(written) {
+        ti_Seek(0, SEEK_SET, var);
+        written = ti_Write(table, sizeof(table), 1, var) == 1;
+    }
 
-        ti_Write((char*)&world.blocks[i], WORLD_SIZE * WORLD_SIZE, 1, var);
+    ti_Close(var);
 
-        ti_SetArchiveStatus(true, var);
+    if(!written) {
+        ti_Delete(temp_name);
+        return false;
+    }
+
+    char name[9];
+    chunk_name(name, world_id, world.window_x + chunk_x, world.window_z + chunk_z);
+    replace_var(temp_name, name);
+    if(!background)
+        archive_var(name);
+
+    world.chunk_dirty &= ~(1 << (chunk_x * WINDOW_CHUNKS + chunk_z));
+    return true;
+}
+
+#define CHUNK_TABLE_SIZE (2 * (WORLD_HEIGHT + 1))
+
+// Reads the layer table at the start of a chunk variable
+bool read_table(uint16_t *table, ti_var_t var) {
+    if(ti_Read(table, CHUNK_TABLE_SIZE, 1, var) != 1) return false;
+
+    for(uint8_t i = 0; i < WORLD_HEIGHT; i++)
+        if(table[i + 1] < table[i] || table[i + 1] > ti_GetSize(var)) return false;
+    return true;
+}
+
+// Reads the chunk variable called name into window chunk (chunk_x, chunk_z),
+// or with no world only checks that every layer of it decodes. Returns false
+// if it's missing or its data is cut short
+bool read_chunk_var(const char *name, world_t *world, uint8_t chunk_x, uint8_t chunk_z) {
+    ti_var_t var = ti_Open(name, "r");
+    if (var == 0) return false;
+
+    uint16_t table[WORLD_HEIGHT + 1];
+    bool read = read_table(table, var);
+
+    Block_t layer[CHUNK_AREA];
+    for(uint8_t y = 0; y < WORLD_HEIGHT && read; y++) {
+        read = ti_Seek(table[y], SEEK_SET, var) != EOF &&
+               read_slice(layer, CHUNK_AREA, var, table[y + 1] - table[y]);
+        if(read && world)
+            world->put_chunk_layer(chunk_x, chunk_z, y, layer, CHUNK_SIZE);
+    }
+
+    ti_Close(var);
+    return read;
+}
+
+// Reads window chunk (chunk_x, chunk_z) from its variable. Returns false if
+// it's missing or its data is cut short
+bool read_chunk(uint8_t world_id, world_t &world, uint8_t chunk_x, uint8_t chunk_z) {
+    char name[9];
+    chunk_name(name, world_id, world.window_x + chunk_x, world.window_z + chunk_z);
+    return read_chunk_var(name, &world, chunk_x, chunk_z);
+}
+
+// Moves the window dx, dz chunks (each -1, 0 or 1) across the map, saving
+// the chunks it leaves that have changes and reading in the ones it reaches.
+// This happens during play, so the saved chunks are left in RAM for the next
+// full save to archive. Returns false, leaving the window where it was, if
+// any of the new chunks are missing or damaged or an old one couldn't be saved
+bool page_window(uint8_t world_id, world_t &world, int8_t dx, int8_t dz) {
+    char name[9];
+
+    // Make sure every new chunk reads back before anything changes, so a
+    // damaged one can't leave a hole in the window
+    for(int8_t x = 0; x < WINDOW_CHUNKS; x++) {
+        for(int8_t z = 0; z < WINDOW_CHUNKS; z++) {
+            if(in_window(x + dx) && in_window(z + dz)) continue;
+
+            chunk_name(name, world_id, world.window_x + dx + x, world.window_z + dz + z);
+            if(!read_chunk_var(name, nullptr, 0, 0)) return false;
+        }
+    }
 
+    for(int8_t x = 0; x < WINDOW_CHUNKS; x++) {
+        for(int8_t z = 0; z < WINDOW_CHUNKS; z++) {
+            if(in_window(x - dx) && in_window(z - dz)) continue;
+
+            if(world.is_chunk_dirty(x, z) && !write_chunk(world_id, world, x, z, true))
+                return false;
+        }
+    }
+
+    world.shift_chunks(dx, dz);
+
+    uint16_t chunk_dirty = 0;
+    for(int8_t x = 0; x < WINDOW_CHUNKS; x++) {
+        for(int8_t z = 0; z < WINDOW_CHUNKS; z++) {
+            if(in_window(x + dx) && in_window(z + dz) && world.is_chunk_dirty(x + dx, z + dz))
+                chunk_dirty |= 1 << (x * WINDOW_CHUNKS + z);
+        }
+    }
+    world.chunk_dirty = chunk_dirty;
+
+    world.window_x += dx;
+    world.window_z += dz;
+
+    for(int8_t x = 0; x < WINDOW_CHUNKS; x++) {
+        for(int8_t z = 0; z < WINDOW_CHUNKS; z++) {
+            if(in_window(x + dx) && in_window(z + dz)) continue;
+
+            // These were all checked above
+            read_chunk(world_id, world, x, z);
+        }
+    }
+
+    // None of the window matches the slice variables any more
+    for(uint8_t y = 0; y < WORLD_HEIGHT; y++)
+        world.mark_slice_dirty(y);
+
+    world.build_columns();
+
+    return true;
+}
+
+// Set when paging the window failed, until the game has told the player
+bool page_failed = false;
+
+// Set after paging the window failed, so it isn't tried again every frame
+// until the player has moved back away from the edge
+bool page_blocked = false;
+
+// Pages the window along the map once the player comes within PAGE_MARGIN
+// blocks of its edge, then rebuilds the triangle grid for it. Everything
+// still in the window keeps its place on screen. Returns true if the window
+// moved, in which case the whole view has to be redrawn. If it couldn't be
+// moved, page_failed is set
+bool follow_player(uint8_t world_id, world_t &world, player_t &player) {
+    int8_t dx = 0;
+    int8_t dz = 0;
+
+    if(player.x < PAGE_MARGIN && world.window_x > 0)
+        dx = -1;
+    else if(player.x >= WORLD_SIZE - PAGE_MARGIN && world.window_x + WINDOW_CHUNKS < world.map_chunks)
+        dx = 1;
+
+    if(player.z < PAGE_MARGIN && world.window_z > 0)
+        dz = -1;
+    else if(player.z >= WORLD_SIZE - PAGE_MARGIN && world.window_z + WINDOW_CHUNKS < world.map_chunks)
+        dz = 1;
+
+    if(dx == 0 && dz == 0) {
+        page_blocked = false;
+        return false;
+    }
+
+    if(page_blocked) return false;
+
+    if(!page_window(world_id, world, dx, dz)) {
+        page_failed = true;
+        page_blocked = true;
+        return false;
+    }
+
+    player.x -= dx * CHUNK_SIZE;
+    player.z -= dz * CHUNK_SIZE;
+
+    scroll_x += (dx - dz) * CHUNK_SIZE * 16;
+    scroll_y -= (dx + dz) * CHUNK_SIZE * 8;
+
+    world.build_tri_grid();
+    return true;
+}
+
+// Deletes every chunk variable a world's map could have
+void erase_chunks(uint8_t world_id) {
+    char name[9];
+    for(uint8_t x = 0; x < MAX_MAP_CHUNKS; x++) {
+        for(uint8_t z = 0; z < MAX_MAP_CHUNKS; z++) {
+            chunk_name(name, world_id, x, z);
+            ti_Delete(name);
+        }
+    }
+}
+
+// Set when the saved triangle grid no longer matches the saved blocks, so
+// the next full save has to rewrite it even if no slices need rewriting
+bool grid_stale = false;
+
+// Bumped whenever the layout of the saved triangle grid changes. Builds
+// with TRI_CELLS save the triangles interleaved, so mark that differently
+#ifdef TRI_CELLS
+#define GRID_VERSION 2
+#else
+#define GRID_VERSION 1
+#endif
+#define GRID_SAVE_SIZE (1 + 3 + 4 * TRI_CNT)
+
+// A Fletcher style checksum of the block data, kept to 24 bits. The saved
+// triangle grid is only used if it was saved alongside these exact blocks
+uint24_t blocks_checksum(world_t &world) {
+    uint24_t sum1 = 0;
+    uint24_t sum2 = 0;
+
+    for(uint8_t y = 0; y < WORLD_HEIGHT; y++) {
+        Block_t *slice = world.slice_blocks(y);
+        for(uint24_t i = 0; i < SLICE_SIZE; i++) {
+            sum1 += slice[i];
+            sum2 += sum1;
+        }
+    }
+
+    return (sum2 ^ (sum1 << 12)) & 0xFFFFFF;
+}
+
+// Saves the triangle grid and shadow map so loading can skip rebuilding them.
+// Returns false if they couldn't be saved
+bool save_grid(uint8_t world_id, world_t &world) {
+    char grid_name[8] = "WORLDAG";
+    grid_name[5] = 'A' + world_id;
+
+    ti_var_t var = ti_Open(grid_name, "w+");
+    if (var == 0) return false;
+
+    uint24_t checksum = blocks_checksum(world);
+
+    ti_PutC(GRID_VERSION, var);
+    ti_PutC((uint8_t)((checksum >> 16) & 0xFF), var);
+    ti_PutC((uint8_t)((checksum >>  8) & 0xFF), var);
+    ti_PutC((uint8_t)((checksum >>  0) & 0xFF), var);
+
+#ifdef TRI_CELLS
+    bool written = ti_Write(world.tri_grid, sizeof(world.tri_grid), 1, var) == 1 &&
+                   ti_Write(world.tri_grid_shadow, TRI_CNT, 1, var) == 1;
+#else
+    bool written = ti_Write(world.tri_grid_tex,   TRI_CNT, 1, var) == 1 &&
+                   ti_Write(world.tri_grid_flags, TRI_CNT, 1, var) == 1 &&
+                   ti_Write(world.tri_grid_depth, TRI_CNT, 1, var) == 1 &&
+                   ti_Write(world.tri_grid_shadow, TRI_CNT, 1, var) == 1;
+#endif
+
+    // Without the room to save all of it, drop the grid and let the next load
+    // rebuild it instead
+    if(!written) {
         ti_Close(var);
+        ti_Delete(grid_name);
+        return false;
     }
+
+    ti_SetArchiveStatus(true, var);
+
+    ti_Close(var);
+    return true;
 }
 
-// Attempts to load a world in from a given ID. Returns true or
-// false depending on if this was successful
-bool load(uint8_t world_id, world_t &world, player_t &player) {
+// Restores the triangle grid and shadow map saved with a world. Returns false,
+// leaving them to be rebuilt, if they are missing or don't match the blocks
+bool load_grid(uint8_t world_id, world_t &world) {
+    char grid_name[8] = "WORLDAG";
+    grid_name[5] = 'A' + world_id;
+
+    ti_var_t var = ti_Open(grid_name, "r");
+    if (var == 0) return false;
+
+    bool valid = ti_GetSize(var) == GRID_SAVE_SIZE && ti_GetC(var) == GRID_VERSION;
+
+    if(valid) {
+        uint24_t checksum = 0;
+        checksum += ti_GetC(var);
+        checksum <<= 8;
+        checksum += ti_GetC(var);
+        checksum <<= 8;
+        checksum += ti_GetC(var);
+
+        valid = checksum == blocks_checksum(world);
+    }
+
+    if(valid) {
+#ifdef TRI_CELLS
+        ti_Read(world.tri_grid, sizeof(world.tri_grid), 1, var);
+        ti_Read(world.tri_grid_shadow, TRI_CNT, 1, var);
+#else
+        ti_Read(world.tri_grid_tex,   TRI_CNT, 1, var);
+        ti_Read(world.tri_grid_flags, TRI_CNT, 1, var);
+        ti_Read(world.tri_grid_depth, TRI_CNT, 1, var);
+        ti_Read(world.tri_grid_shadow, TRI_CNT, 1, var);
+#endif
+    }
+
+    ti_Close(var);
+
+#ifdef TRI_RUNS
+    // The run bits aren't saved since they follow from the grid
+    if(valid)
+        world.init_tri_runs();
+#endif
+
+    return valid;
+}
+
+// Archives a world's header, slice and chunk variables wherever they're
+// still in RAM
+void archive_world(uint8_t world_id, world_t &world) {
     char filename[7] = "WORLDA";
     filename[5] = 'A' + world_id;
+    archive_var(filename);
 
-    // Load player position
-    {
-        ti_var_t var = ti_Open(filename, "r");
-        if (var == 0) return false;
+    char name[9];
+    for(uint8_t i = 0; i < WORLD_HEIGHT; i++) {
+        slice_name(name, world_id, i);
+        archive_var(name);
+    }
 
-        player.x = (int24_t)ti_GetC(var);
-        player.y = (int24_t)ti_GetC(var);
-        player.z = (int24_t)ti_GetC(var);
+    for(uint8_t x = 0; x < world.map_chunks; x++) {
+        for(uint8_t z = 0; z < world.map_chunks; z++) {
+            chunk_name(name, world_id, x, z);
+            archive_var(name);
+        }
+    }
+}
 
-        player.current_block = ti_GetC(var);
+// Saves a world and player position details. Only the slices changed since
+// the last load or save are rewritten, along with the header. Background
+// saves are made during play, where archiving could bring up the garbage
+// collect prompt over the game, so they leave everything in RAM and skip the
+// progress bar and the triangle grid, by far the biggest file. The next full
+// save archives it all; until then loading just rebuilds the grid
+// (world_id should be 1-5 though that limit is only imposed by the UI)
+void save(uint8_t world_id, world_t &world, player_t &player, bool background = false) {
+    char filename[7] = "WORLDA";
+    filename[5] = 'A' + world_id;
 
-        scroll_x = 0;
-        scroll_x += ti_GetC(var);
-        scroll_x <<= 8; 
-        scroll_x += ti_GetC(var);
-        scroll_x <<= 8; 
-        scroll_x += ti_GetC(var);
+    if(world.any_slice_dirty())
+        grid_stale = true;
 
-        scroll_y = 0;
-        scroll_y += ti_GetC(var);
-        scroll_y <<= 8; 
-        scroll_y += ti_GetC(var);
-        scroll_y <<= 8; 
-        scroll_y += ti_GetC(var);
+    if(!background) {
+        // Put away anything background saves left in RAM first, to make room
+        archive_world(world_id, world);
+    }
 
-        ti_SetArchiveStatus(true, var);
+    for(uint8_t i = 0; i < WORLD_HEIGHT; i++) {
+        if(!background)
+            fill_progress_bar(i, WORLD_HEIGHT);
 
-        ti_Close(var);
+        if(!world.is_slice_dirty(i)) continue;
+
+        if(!write_slice_var(world_id, world, i)) return;
+        world.clean_slice(i);
+
+        if(!background) {
+            char name[9];
+            slice_name(name, world_id, i);
+            archive_var(name);
+        }
     }
 
-    char out_name[9] = "WORLDA00";
-    out_name[5] = 'A' + world_id;
+    if(!write_header(world_id, world, player)) return;
 
-    // To save RAM, worlds are stored and loaded one horizontal slice
-    // at a time
-    for(uint8_t i = 0; i < WORLD_HEIGHT; i++) {
-        // Set the digit counter to the world level
-        out_name[6] = '0' + (i / 10);
-        out_name[7] = '0' + (i % 10);
+    if(background) return;
 
-        /* Open a new variable; deleting it if it already exists */
-        ti_var_t var = ti_Open(out_name, "r");
-        if (var == 0) return false;
+    archive_var(filename);
+
+    if(grid_stale)
+        grid_stale = !save_grid(world_id, world);
+}
+
+// Attempts to load a world in from a given ID, along with its triangle
+// grid. Returns true or false depending on if this was successful
+bool load(uint8_t world_id, world_t &world, player_t &player) {
+    char filename[7] = "WORLDA";
+    filename[5] = 'A' + world_id;
+
+    ti_var_t var = ti_Open(filename, "r");
+    if (var == 0) return false;
 
-        ti_Read((char*)&world.blocks[i], WORLD_SIZE * WORLD_SIZE, 1, var);
+    bool read;
+
+    if(ti_GetSize(var) == LEGACY_HEADER_SIZE) {
+        read_player(player, var);
+        ti_Close(var);
 
+        world.reset_map();
+        read = read_slice_vars(world_id, world);
+    }
+    else {
+        char magic[3];
+        read = ti_Read(magic, 3, 1, var) == 1 && memcmp(magic, WORLD_MAGIC, 3) == 0 &&
+               ti_GetC(var) == WORLD_VERSION &&
+               ti_GetC(var) == WORLD_SIZE &&
+               ti_GetC(var) == WORLD_HEIGHT;
+
+        if(read) {
+            read_player(player, var);
+            read = read_map(world, var);
+        }
         ti_Close(var);
+
+        if(read)
+            read = read_slice_vars(world_id, world);
     }
 
+    if(!read) return false;
+
+    world.build_columns();
+
+    // Everything now matches what's saved
+    world.clear_slice_dirty();
+
+    // Use the saved triangle grid when it matches, and otherwise build it
+    // from the blocks
+    grid_stale = !load_grid(world_id, world);
+    if(grid_stale)
+        world.build_tri_grid();
+
     return true;
 }
 
@@ -123,15 +777,13 @@ void erase(uint8_t world_id) {
     char filename[7] = "WORLDA";
     filename[5] = 'A' + world_id;
 
-    if(ti_Delete(filename) == 0) return;
-
-    char out_name[9] = "WORLDA00";
-    out_name[5] = 'A' + world_id;
+    // Delete the rest even without a header, since generating a map writes
+    // its chunks before the first save writes the header
+    ti_Delete(filename);
+    erase_slices(world_id);
+    erase_chunks(world_id);
 
-    for(uint8_t i = 0; i < WORLD_HEIGHT; i++) {
-        // Set the digit counter to the world level
-        out_name[6] = '0' + (i / 10);
-        out_name[7] = '0' + (i % 10);
-        ti_Delete(out_name);
-    }
-}
\ No newline at end of file
+    char grid_name[8] = "WORLDAG";
+    grid_name[5] = 'A' + world_id;
+    ti_Delete(grid_name);
+}
@@ -2,27 +2,32 @@
 #include <sys/util.h>
 #include "world.h"
 #include "player.h"
+#include "world_io.h"
 
 #define WATER_LEVEL 5
 
 #define GRID_STEP 8
 #define GRID_OFFSET (GRID_STEP / 2)
 #define GRID_SIZE ((WORLD_SIZE / GRID_STEP) + 1)
+#define MAP_GRID_SIZE ((MAX_MAP_CHUNKS * CHUNK_SIZE / GRID_STEP) + 1)
 
-// Makes a "natural" looking world with randomly generated terrain and trees
-void generate_natural(world_t &world, player_t &player) {
+// Fills a stride wide grid of terrain heights
+void fill_height_grid(uint16_t *grid, uint8_t size, uint8_t stride) {
+    for(uint8_t x = 0; x < size; x++) {
+        for(uint8_t z = 0; z < size; z++) {
+            grid[x * stride + z] = randInt(3, 12);
+        }
+    }
+}
+
+// Makes a "natural" looking world with randomly generated terrain and trees,
+// whose heights are interpolated between the GRID_SIZE x GRID_SIZE points
+// of a stride wide grid. Windows of a map share the points along their edges
+void generate_natural(world_t &world, player_t &player, uint16_t *grid, uint8_t stride) {
     // Add bedrock floor
     world.fill_space(0, 0, 0, WORLD_SIZE - 1,           0, WORLD_SIZE - 1, BEDROCK);
     world.fill_space(0, 1, 0, WORLD_SIZE - 1, WATER_LEVEL, WORLD_SIZE - 1, WATER);
 
-    uint16_t grid[GRID_SIZE][GRID_SIZE];
-
-    for(uint8_t x = 0; x < GRID_SIZE; x++) {
-        for(uint8_t z = 0; z < GRID_SIZE; z++) {
-            grid[x][z] = randInt(3, 12);
-        }
-    }
-
 
     for(uint8_t x = 0; x < WORLD_SIZE; x++) {
         for(uint8_t z = 0; z < WORLD_SIZE; z++) {
@@ -34,10 +39,12 @@ void generate_natural(world_t &world, player_t &player) {
 
             uint16_t height = 0;
 
-            height += grid[grid_x    ][grid_z    ] * (GRID_STEP - lerp_x) * (GRID_STEP - lerp_z);
-            height += grid[grid_x + 1][grid_z    ] * (            lerp_x) * (GRID_STEP - lerp_z);
-            height += grid[grid_x    ][grid_z + 1] * (GRID_STEP - lerp_x) * (            lerp_z);
-            height += grid[grid_x + 1][grid_z + 1] * (            lerp_x) * (            lerp_z);
+            uint16_t *corner = &grid[grid_x * stride + grid_z];
+
+            height += corner[0         ] * (GRID_STEP - lerp_x) * (GRID_STEP - lerp_z);
+            height += corner[stride    ] * (            lerp_x) * (GRID_STEP - lerp_z);
+            height += corner[1         ] * (GRID_STEP - lerp_x) * (            lerp_z);
+            height += corner[stride + 1] * (            lerp_x) * (            lerp_z);
 
             height /= GRID_STEP * GRID_STEP;
 
@@ -59,9 +66,9 @@ void generate_natural(world_t &world, player_t &player) {
     for(uint8_t y = WATER_LEVEL - 1; y <= WATER_LEVEL; y++) {
         for(uint8_t x = 0; x < WORLD_SIZE; x++) {
             for(uint8_t z = 0; z < WORLD_SIZE; z++) {
-                if(world.blocks[y][x][z] != GRASS && world.blocks[y][x][z] != DIRT) continue;
+                if(world.block_at(x, y, z) != GRASS && world.block_at(x, y, z) != DIRT) continue;
                 if(y >= WORLD_HEIGHT - 1) continue;
-                if(world.blocks[y + 1][x][z] != AIR && world.blocks[y + 1][x][z] != WATER) continue;
+                if(world.block_at(x, y + 1, z) != AIR && world.block_at(x, y + 1, z) != WATER) continue;
 
                 bool near_water = false;
 
@@ -74,14 +81,14 @@ void generate_natural(world_t &world, player_t &player) {
                         for(int8_t bz = -2; bz <= 2; bz++) {
                             if(z + bz < 0 || z + bz >= WORLD_SIZE) continue;
 
-                            if(world.blocks[by + y][bx + x][bz + z] == WATER)
+                            if(world.block_at(bx + x, by + y, bz + z) == WATER)
                                 near_water = true;
                         }
                     }
                 }
 
                 if(near_water)
-                    world.blocks[y][x][z] = SAND;
+                    world.store_block(x, y, z, SAND);
             }
         }
     }
@@ -97,33 +104,37 @@ void generate_natural(world_t &world, player_t &player) {
 
         int8_t y = WORLD_HEIGHT - 8;
 
-        if(world.blocks[y + 1][x][z] != AIR) continue;
+        if(world.block_at(x, y + 1, z) != AIR) continue;
+
+        // Start from the top of the column unless something overhangs it
+        if(world.column_height[x][z] <= y + 1)
+            y = world.column_height[x][z] > 0 ? world.column_height[x][z] - 1 : 0;
 
         while(y > 0) {
-            if(world.blocks[y][x][z] != AIR) break; 
+            if(world.block_at(x, y, z) != AIR) break; 
             y--;
         }
 
-        if(world.blocks[y][x][z] != GRASS) break;
+        if(world.block_at(x, y, z) != GRASS) break;
 
         world.add_tree(x, y + 1, z);
-        world.blocks[y][x][z] = DIRT;
+        world.store_block(x, y, z, DIRT);
     }
 
     // Replace a few stone blocks with coal
     for(uint8_t y = 1; y < WORLD_HEIGHT; y++) {
         for(uint8_t x = 0; x < WORLD_SIZE; x++) {
             for(uint8_t z = 0; z < WORLD_SIZE; z++) {
-                if(world.blocks[y][x][z] != STONE) continue;
+                if(world.block_at(x, y, z) != STONE) continue;
 
                 int24_t r = randInt(0, 19);
 
                 // Replace stone with coal or iron ore at a 10% chance
                 if(r == 0) {
-                    world.blocks[y][x][z] = COAL_ORE;
+                    world.store_block(x, y, z, COAL_ORE);
                 }
                 else if(r == 1) {
-                    world.blocks[y][x][z] = IRON_ORE;
+                    world.store_block(x, y, z, IRON_ORE);
                 }
             }
         }
@@ -135,11 +146,19 @@ void generate_natural(world_t &world, player_t &player) {
     player.z = WORLD_SIZE / 2;
 
     while(player.y <= (WORLD_HEIGHT - 1)) {
-        if(world.blocks[player.y][player.x][player.z] == AIR) break;
+        if(world.block_at(player.x, player.y, player.z) == AIR) break;
         player.y++;
     }
 }
 
+// Makes a "natural" looking world the size of the window
+void generate_natural(world_t &world, player_t &player) {
+    uint16_t grid[GRID_SIZE][GRID_SIZE];
+    fill_height_grid(&grid[0][0], GRID_SIZE, GRID_SIZE);
+
+    generate_natural(world, player, &grid[0][0], GRID_SIZE);
+}
+
 // Makes ths demo world with a bunch of neat little structures
 void generate_demo(world_t &world, player_t &player) {
     // Add grass floor
@@ -204,4 +223,76 @@ void generate_flat(world_t &world, player_t &player) {
     player.x = WORLD_SIZE / 2;
     player.y = 1;
     player.z = WORLD_SIZE / 2;
-}
\ No newline at end of file
+}
+
+// The kinds of world on offer, in the order of the menu
+enum world_type {
+    NATURAL_WORLD,
+    FLAT_WORLD,
+    DEMO_WORLD,
+};
+
+// Makes a new map map_chunks chunks across, with the player in the middle of
+// it. Bigger maps are generated a window at a time, saving each window's
+// chunks to their variables, and the middle window is made last and kept
+// (its chunks are saved when they're paged out).
+// Demo maps only have the structures in the middle, with flat ground around
+// them. Returns false if the chunks couldn't all be saved
+bool generate_map(uint8_t world_id, world_t &world, player_t &player, uint8_t type, uint8_t map_chunks) {
+    static uint16_t grid[MAP_GRID_SIZE][MAP_GRID_SIZE];
+    if(type == NATURAL_WORLD)
+        fill_height_grid(&grid[0][0], (map_chunks * CHUNK_SIZE / GRID_STEP) + 1, MAP_GRID_SIZE);
+
+    uint8_t windows = map_chunks / WINDOW_CHUNKS;
+    uint8_t middle = windows / 2;
+
+    for(uint8_t i = 0; i < windows * windows; i++) {
+        // Count through the windows so the middle one is last
+        uint8_t window = (i + middle * windows + middle + 1) % (windows * windows);
+        uint8_t window_x = window / windows;
+        uint8_t window_z = window % windows;
+
+        world.clear_world();
+        world.map_chunks = map_chunks;
+        world.window_x = window_x * WINDOW_CHUNKS;
+        world.window_z = window_z * WINDOW_CHUNKS;
+
+        if(windows > 1)
+            fill_progress_bar(i, windows * windows);
+
+        player_t window_player;
+        bool middle_window = window_x == middle && window_z == middle;
+
+        switch(type) {
+            case NATURAL_WORLD:
+                generate_natural(world, window_player,
+                                 &grid[window_x * WORLD_SIZE / GRID_STEP][window_z * WORLD_SIZE / GRID_STEP],
+                                 MAP_GRID_SIZE);
+                break;
+            case FLAT_WORLD:
+                generate_flat(world, window_player);
+                break;
+            case DEMO_WORLD:
+                if(middle_window)
+                    generate_demo(world, window_player);
+                else
+                    generate_flat(world, window_player);
+                break;
+        }
+
+        if(middle_window) {
+            player.x = window_player.x;
+            player.y = window_player.y;
+            player.z = window_player.z;
+            break;
+        }
+
+        for(uint8_t x = 0; x < WINDOW_CHUNKS; x++) {
+            for(uint8_t z = 0; z < WINDOW_CHUNKS; z++) {
+                if(!write_chunk(world_id, world, x, z)) return false;
+            }
+        }
+    }
+
+    return true;
+}